@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <time.h>
+
+namespace bench {
+
+    inline double now_seconds()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+
+    /// reads the n'th command line argument as an unsigned integer, falling
+    /// back to a default when it is absent
+    inline unsigned int arg(int argc, char** argv, int n, unsigned int dflt)
+    {
+        return argc > n ? static_cast<unsigned int>(std::atoi(argv[n])) : dflt;
+    }
+
+
+    inline void report(const char* name, unsigned long ops, double seconds)
+    {
+        std::printf("%-40s %12lu ops %10.3f s %14.0f ops/s\n",
+                name, ops, seconds, ops / seconds);
+    }
+}
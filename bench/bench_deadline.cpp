@@ -0,0 +1,41 @@
+// Reports the calibrated time stamp counter rate and how long a spin of the
+// elimination loop takes with and without a pause, for translating
+// spin-count timeouts into the nanosecond timeouts taken by tsc_deadline.
+//
+// usage: bench_deadline [spins]
+
+#include "mpm/atomic.hpp"
+#include "mpm/deadline.hpp"
+#include "bench.hpp"
+
+namespace {
+
+    // polled on every spin, as the elimination loop polls its slot
+    int slot(0);
+
+
+    template <bool Pause>
+    double ns_per_spin(unsigned int spins)
+    {
+        mpm::spin_deadline deadline(spins);
+        double start(bench::now_seconds());
+        while(!deadline.expired() &&
+                0 == MPM_LOAD(&slot, mpm::memory_order_acquire))
+        {
+            if(Pause)
+                MPM_CPU_RELAX();
+        }
+        return (bench::now_seconds() - start) * 1e9 / spins;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    unsigned int spins(bench::arg(argc, argv, 1, 10000000));
+
+    std::printf("%-40s %14.3f\n", "tsc cycles per ns", mpm::calibrate_tsc());
+    std::printf("%-40s %14.3f\n", "ns per spin", ns_per_spin<false>(spins));
+    std::printf("%-40s %14.3f\n", "ns per paused spin", ns_per_spin<true>(spins));
+    return 0;
+}
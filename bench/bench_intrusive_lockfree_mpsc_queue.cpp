@@ -0,0 +1,126 @@
+// Measures the rate at which a single consumer drains an
+// intrusive_lockfree_mpsc_queue that several producers are filling, once for
+// each queue layout popping one value at a time and once popping in bulk,
+// then with the producers pushing chains of 32 values.
+//
+// usage: bench_intrusive_lockfree_mpsc_queue [producers] [entries_per_producer]
+
+#include "mpm/intrusive_lockfree_mpsc_queue.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+    struct entry : mpm::intrusive_lockfree_mpsc_queue_entry<entry>
+    {
+        unsigned int value;
+    };
+
+
+    template <typename Queue>
+    struct producer_data
+    {
+        Queue* queue;
+        pthread_barrier_t* start_barrier;
+        entry* entries;
+        unsigned int count;
+        unsigned int batch;
+    };
+
+
+    template <typename Queue>
+    void* producer(void* in)
+    {
+        producer_data<Queue>* data(static_cast<producer_data<Queue>*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        for(unsigned int i = 0; i < data->count; i += data->batch)
+        {
+            unsigned int last(std::min(i + data->batch, data->count) - 1);
+            for(unsigned int j = i; j < last; j++)
+                mpm_intrusive_lockfree_mpsc_queue_set_next(
+                        data->entries[j], &data->entries[j + 1]);
+            data->queue->push_chain(data->entries[i], data->entries[last]);
+        }
+        return 0;
+    }
+
+
+    struct pop_one
+    {
+        template <typename Queue>
+        unsigned long operator()(Queue& queue)
+        {
+            return queue.pop() ? 1 : 0;
+        }
+    };
+
+
+    struct pop_bulk
+    {
+        template <typename Queue>
+        unsigned long operator()(Queue& queue)
+        {
+            entry* popped[64];
+            return queue.pop_bulk(popped, 64);
+        }
+    };
+
+
+    template <typename Queue, typename Pop>
+    void run(const char* name, unsigned int producers,
+            unsigned int per_producer, unsigned int batch=1)
+    {
+        Queue queue;
+        std::vector<entry> entries(producers * per_producer);
+        std::vector<pthread_t> threads(producers);
+        std::vector<producer_data<Queue> > data(producers);
+
+        pthread_barrier_t start_barrier;
+        pthread_barrier_init(&start_barrier, NULL, producers + 1);
+        for(unsigned int i = 0; i < producers; i++)
+        {
+            producer_data<Queue> d =
+                { &queue, &start_barrier, &entries[i * per_producer],
+                  per_producer, batch };
+            data[i] = d;
+            pthread_create(&threads[i], NULL, &producer<Queue>, &data[i]);
+        }
+
+        unsigned long total(entries.size()), popped(0);
+        pthread_barrier_wait(&start_barrier);
+        double start(bench::now_seconds());
+        Pop pop;
+        while(popped < total)
+            popped += pop(queue);
+        double elapsed(bench::now_seconds() - start);
+
+        for(unsigned int i = 0; i < producers; i++)
+            pthread_join(threads[i], NULL);
+        pthread_barrier_destroy(&start_barrier);
+
+        bench::report(name, total, elapsed);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    unsigned int producers(bench::arg(argc, argv, 1, 8));
+    unsigned int per_producer(bench::arg(argc, argv, 2, 1000000));
+
+    std::printf("consumer pop rate with %u producers\n", producers);
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry, mpm::mpsc_compact_layout>
+        compact;
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry, mpm::mpsc_padded_layout>
+        padded;
+    run<compact, pop_one>("mpsc_compact_layout", producers, per_producer);
+    run<padded, pop_one>("mpsc_padded_layout", producers, per_producer);
+    run<compact, pop_bulk>("mpsc_compact_layout pop_bulk", producers, per_producer);
+    run<padded, pop_bulk>("mpsc_padded_layout pop_bulk", producers, per_producer);
+    run<padded, pop_one>("mpsc_padded_layout push_chain", producers,
+            per_producer, 32);
+    run<padded, pop_bulk>("mpsc_padded_layout push_chain pop_bulk", producers,
+            per_producer, 32);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Measures the per-operation cost of each intrusive_lockfree_stack
+// reclamation policy. Every thread repeatedly pops an entry and pushes a
+// replacement; with no_reclamation the popped entry itself is pushed back,
+// otherwise it is retired to the policy's domain and a new one allocated.
+//
+// usage: bench_reclamation [threads] [iterations_per_thread]
+
+#include "mpm/epoch.hpp"
+#include "mpm/hazard_pointer.hpp"
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "bench.hpp"
+#include <vector>
+
+namespace {
+
+    struct entry : mpm::intrusive_lockfree_stack_entry<entry>
+    {
+        unsigned int value;
+    };
+
+
+    // how a popped entry is disposed of and replaced under each policy
+    template <typename Reclaim>
+    struct recycler;
+
+    template <>
+    struct recycler<mpm::no_reclamation>
+    {
+        static entry* replace(entry* popped)
+        {
+            return popped;
+        }
+    };
+
+    template <>
+    struct recycler<mpm::hazard_pointer_reclamation>
+    {
+        static entry* replace(entry* popped)
+        {
+            mpm::hazard_pointer_domain::global().retire(popped);
+            return new entry;
+        }
+    };
+
+    template <>
+    struct recycler<mpm::epoch_reclamation>
+    {
+        static entry* replace(entry* popped)
+        {
+            mpm::epoch_domain::global().retire(popped);
+            return new entry;
+        }
+    };
+
+
+    template <typename Reclaim>
+    struct stack_of
+    {
+        typedef mpm::intrusive_lockfree_stack<entry, mpm::disable_elimination,
+                uint16_t, mpm::no_backoff, Reclaim> type;
+    };
+
+
+    template <typename Reclaim>
+    struct churn_data
+    {
+        typename stack_of<Reclaim>::type* stack;
+        pthread_barrier_t* start_barrier;
+        unsigned int iterations;
+    };
+
+
+    template <typename Reclaim>
+    void* churn(void* in)
+    {
+        churn_data<Reclaim>* data(static_cast<churn_data<Reclaim>*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        for(unsigned int i = 0; i < data->iterations; i++)
+        {
+            entry* popped(data->stack->pop());
+            if(popped)
+                data->stack->push(*recycler<Reclaim>::replace(popped));
+        }
+        pthread_barrier_wait(data->start_barrier);
+        return 0;
+    }
+
+
+    template <typename Reclaim>
+    void run(const char* name, unsigned int threads, unsigned int iterations)
+    {
+        typename stack_of<Reclaim>::type stack;
+        for(unsigned int i = 0; i < threads * 2; i++)
+            stack.push(*new entry);
+
+        std::vector<pthread_t> tids(threads);
+        std::vector<churn_data<Reclaim> > data(threads);
+        pthread_barrier_t start_barrier;
+        pthread_barrier_init(&start_barrier, NULL, threads + 1);
+        for(unsigned int i = 0; i < threads; i++)
+        {
+            churn_data<Reclaim> d = { &stack, &start_barrier, iterations };
+            data[i] = d;
+            pthread_create(&tids[i], NULL, &churn<Reclaim>, &data[i]);
+        }
+
+        pthread_barrier_wait(&start_barrier);
+        double start(bench::now_seconds());
+        pthread_barrier_wait(&start_barrier);
+        double elapsed(bench::now_seconds() - start);
+
+        for(unsigned int i = 0; i < threads; i++)
+            pthread_join(tids[i], NULL);
+        pthread_barrier_destroy(&start_barrier);
+        while(entry* popped = stack.pop())
+            delete popped;
+
+        bench::report(name, static_cast<unsigned long>(threads) * iterations,
+                elapsed);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    unsigned int threads(bench::arg(argc, argv, 1, 4));
+    unsigned int iterations(bench::arg(argc, argv, 2, 1000000));
+
+    std::printf("stack pop/push rate with %u threads\n", threads);
+    run<mpm::no_reclamation>("no_reclamation", threads, iterations);
+    run<mpm::hazard_pointer_reclamation>(
+            "hazard_pointer_reclamation", threads, iterations);
+    run<mpm::epoch_reclamation>("epoch_reclamation", threads, iterations);
+    return 0;
+}
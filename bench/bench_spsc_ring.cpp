@@ -0,0 +1,168 @@
+// Measures the rate at which values pass from one producer to one consumer
+// through an spsc_ring, copying them one at a time and in place in batches,
+// and through an intrusive_lockfree_mpsc_queue for comparison. Both sides
+// yield whenever the ring is full or empty so that the run still finishes
+// when they share a cpu.
+//
+// usage: bench_spsc_ring [values] [batch]
+
+#include "mpm/intrusive_lockfree_mpsc_queue.hpp"
+#include "mpm/spsc_ring.hpp"
+#include "bench.hpp"
+#include <sched.h>
+#include <vector>
+
+namespace {
+
+    typedef mpm::spsc_ring<unsigned long, 4096> ring_type;
+
+
+    struct entry : mpm::intrusive_lockfree_mpsc_queue_entry<entry>
+    {
+        unsigned long value;
+    };
+
+
+    struct run_data
+    {
+        ring_type* ring;
+        mpm::intrusive_lockfree_mpsc_queue<entry>* queue;
+        std::vector<entry>* entries;
+        pthread_barrier_t* start_barrier;
+        unsigned long count;
+        unsigned long batch;
+    };
+
+
+    void* copying_producer(void* in)
+    {
+        run_data* data(static_cast<run_data*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        for(unsigned long i = 0; i < data->count; i++)
+        {
+            while(!data->ring->try_push(i))
+                sched_yield();
+        }
+        return 0;
+    }
+
+
+    void* batching_producer(void* in)
+    {
+        run_data* data(static_cast<run_data*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        unsigned long next(0);
+        while(next < data->count)
+        {
+            unsigned long* slots;
+            std::size_t n(data->ring->reserve(slots, data->batch));
+            if(0 == n)
+                sched_yield();
+            std::size_t filled(0);
+            for(; filled < n && next < data->count; filled++)
+                slots[filled] = next++;
+            data->ring->commit(filled);
+        }
+        return 0;
+    }
+
+
+    void* queue_producer(void* in)
+    {
+        run_data* data(static_cast<run_data*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        for(unsigned long i = 0; i < data->count; i++)
+            data->queue->push((*data->entries)[i]);
+        return 0;
+    }
+
+
+    unsigned long copying_consumer(run_data& data)
+    {
+        unsigned long sum(0), value;
+        for(unsigned long i = 0; i < data.count; i++)
+        {
+            while(!data.ring->try_pop(value))
+                sched_yield();
+            sum += value;
+        }
+        return sum;
+    }
+
+
+    unsigned long batching_consumer(run_data& data)
+    {
+        unsigned long sum(0), popped(0);
+        while(popped < data.count)
+        {
+            unsigned long* values;
+            std::size_t n(data.ring->peek(values, data.batch));
+            if(0 == n)
+                sched_yield();
+            for(std::size_t i = 0; i < n; i++)
+                sum += values[i];
+            data.ring->consume(n);
+            popped += n;
+        }
+        return sum;
+    }
+
+
+    unsigned long queue_consumer(run_data& data)
+    {
+        unsigned long sum(0);
+        for(unsigned long i = 0; i < data.count; i++)
+        {
+            entry* e;
+            while(!(e = data.queue->pop()))
+                sched_yield();
+            sum += e->value;
+        }
+        return sum;
+    }
+
+
+    void run(const char* name, void* (*produce)(void*),
+            unsigned long (*consume)(run_data&), unsigned long count,
+            unsigned long batch)
+    {
+        ring_type ring;
+        mpm::intrusive_lockfree_mpsc_queue<entry> queue;
+        std::vector<entry> entries(produce == &queue_producer ? count : 0);
+        for(unsigned long i = 0; i < entries.size(); i++)
+            entries[i].value = i;
+
+        pthread_barrier_t start_barrier;
+        pthread_barrier_init(&start_barrier, NULL, 2);
+        run_data data = { &ring, &queue, &entries, &start_barrier, count, batch };
+        pthread_t thread;
+        pthread_create(&thread, NULL, produce, &data);
+
+        pthread_barrier_wait(&start_barrier);
+        double start(bench::now_seconds());
+        unsigned long sum(consume(data));
+        double elapsed(bench::now_seconds() - start);
+
+        pthread_join(thread, NULL);
+        pthread_barrier_destroy(&start_barrier);
+        if(sum != count * (count - 1) / 2)
+            std::printf("%s: lost values\n", name);
+        bench::report(name, count, elapsed);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    unsigned long count(bench::arg(argc, argv, 1, 20000000));
+    unsigned long batch(bench::arg(argc, argv, 2, 64));
+
+    std::printf("single producer to single consumer\n");
+    run("spsc_ring try_push/try_pop", &copying_producer, &copying_consumer,
+            count, 1);
+    run("spsc_ring reserve/commit", &batching_producer, &batching_consumer,
+            count, batch);
+    run("intrusive_lockfree_mpsc_queue", &queue_producer, &queue_consumer,
+            count / 10, 1);
+    return 0;
+}
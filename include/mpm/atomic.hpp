@@ -1,6 +1,8 @@
 #pragma once
 
-#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+// The gcc backend is built on the __atomic builtins (gcc >= 4.7, clang >= 3.1)
+// which the compiler advertises by predefining the __ATOMIC_* orderings
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER) && defined(__ATOMIC_RELAXED)
     #include "mpm/atomic_gcc.hpp"
 #else
     error Atomic operations not defined for this compiler
@@ -1,8 +1,149 @@
 #pragma once
 
+#include <stdint.h>
+
+namespace mpm {
+
+    /// Memory ordering constraints for the MPM_* atomic operations. The
+    /// values map directly onto the __atomic builtin orderings so they can be
+    /// handed straight to the compiler.
+    enum memory_order
+    {
+        memory_order_relaxed = __ATOMIC_RELAXED,
+        memory_order_acquire = __ATOMIC_ACQUIRE,
+        memory_order_release = __ATOMIC_RELEASE,
+        memory_order_acq_rel = __ATOMIC_ACQ_REL,
+        memory_order_seq_cst = __ATOMIC_SEQ_CST
+    };
+
+
+    namespace detail {
+
+        /// The failure ordering of a CAS may not be stronger than its success
+        /// ordering and may not have release semantics
+        inline memory_order cas_failure_order(memory_order success)
+        {
+            return success == memory_order_acq_rel ? memory_order_acquire
+                 : success == memory_order_release ? memory_order_relaxed
+                 : success;
+        }
+
+
+        template <typename T>
+        inline bool cas(T* storage, T expected, T new_val,
+                memory_order success, memory_order failure)
+        {
+            return __atomic_compare_exchange_n(storage, &expected, new_val,
+                    false, success, failure);
+        }
+
+
+        /// A pair of machine words that can be compared and swapped as a
+        /// single unit
+        struct double_word
+        {
+            uint64_t lo;
+            uint64_t hi;
+        } __attribute__((aligned(16)));
+    }
+}
+
+
+#if defined(__x86_64__)
+
+    #define MPM_HAS_DWCAS 1
+
+    namespace mpm { namespace detail {
+
+        // cmpxchg16b is always a full barrier so no ordering is taken. It is
+        // issued directly rather than through the __atomic builtins because
+        // those only inline it under -mcx16 and otherwise call into
+        // libatomic. On failure the observed value is written to *expected.
+        inline bool dwcas(double_word* storage, double_word* expected,
+                double_word new_val)
+        {
+            bool success;
+            __asm__ __volatile__("lock; cmpxchg16b %1\n\tsetz %0"
+                    : "=q"(success), "+m"(*storage),
+                      "+a"(expected->lo), "+d"(expected->hi)
+                    : "b"(new_val.lo), "c"(new_val.hi)
+                    : "cc", "memory");
+            return success;
+        }
+    }}
+
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+
+    #define MPM_HAS_DWCAS 1
+
+    namespace mpm { namespace detail {
+
+        inline bool dwcas(double_word* storage, double_word* expected,
+                double_word new_val)
+        {
+            typedef unsigned __int128 raw_type;
+            raw_type raw_expected(
+                    (raw_type(expected->hi) << 64) | expected->lo);
+            raw_type raw_new((raw_type(new_val.hi) << 64) | new_val.lo);
+            if(__atomic_compare_exchange_n(
+                    reinterpret_cast<raw_type*>(storage), &raw_expected,
+                    raw_new, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                return true;
+            expected->lo = static_cast<uint64_t>(raw_expected);
+            expected->hi = static_cast<uint64_t>(raw_expected >> 64);
+            return false;
+        }
+    }}
+
+#endif
+
+
+// Hints to the processor that we are in a spin-wait loop so that it can
+// yield pipeline resources to an SMT sibling and avoid a memory order
+// violation on loop exit
+#if defined(__x86_64__) || defined(__i386__)
+    #define MPM_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+    #define MPM_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+    #define MPM_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+
+#define MPM_LOAD(storage, order) \
+    __atomic_load_n(storage, order)
+
+#define MPM_STORE(storage, value, order) \
+    __atomic_store_n(storage, value, order)
+
+#define MPM_EXCHG_EXPLICIT(storage, value, order) \
+    __atomic_exchange_n(storage, value, order)
+
+#define MPM_FETCH_ADD(storage, value, order) \
+    __atomic_fetch_add(storage, value, order)
+
+#define MPM_CAS_EXPLICIT(val, expected, new_val, order) \
+    mpm::detail::cas(val, expected, new_val, order, \
+            mpm::detail::cas_failure_order(order))
+
+// Like MPM_CAS_EXPLICIT but takes a pointer to the expected value which is
+// overwritten with the observed value when the CAS fails. A weak CAS may fail
+// spuriously.
+#define MPM_COMPARE_EXCHANGE(val, expected_ptr, new_val, weak, order) \
+    __atomic_compare_exchange_n(val, expected_ptr, new_val, weak, order, \
+            mpm::detail::cas_failure_order(order))
+
+#define MPM_FENCE(order) \
+    __atomic_thread_fence(order)
+
 #define MPM_CAS(val, expected, new_val) \
-    __sync_bool_compare_and_swap(val, expected, new_val)
+    MPM_CAS_EXPLICIT(val, expected, new_val, mpm::memory_order_seq_cst)
 
 #define MPM_EXCHG(storage, value) \
-    __sync_lock_test_and_set(storage, value)
+    MPM_EXCHG_EXPLICIT(storage, value, mpm::memory_order_seq_cst)
 
+#if defined(MPM_HAS_DWCAS)
+    // expected_ptr is overwritten with the observed value on failure
+    #define MPM_DWCAS(storage, expected_ptr, new_val) \
+        mpm::detail::dwcas(storage, expected_ptr, new_val)
+#endif
@@ -7,7 +7,8 @@
 namespace mpm {
 
     /// Packs a pointer and a short into 64 bits and allows for atomic read,
-    /// write, and CAS on them.
+    /// write, and CAS on them. Every operation takes an optional memory
+    /// ordering which defaults to sequential consistency.
     template <typename T, typename Tag=uint16_t>
     class atomic_tagged_ptr
     {
@@ -19,10 +20,23 @@ namespace mpm {
 
         atomic_tagged_ptr(ptr_type ptr=0, tag_type tag=0);
 
-        ptr_type get(tag_type & tag_out) const;
-        void set(ptr_type ptr, tag_type tag);
+        ptr_type get(tag_type & tag_out,
+                memory_order order=memory_order_seq_cst) const;
+        void set(ptr_type ptr, tag_type tag,
+                memory_order order=memory_order_seq_cst);
         bool compare_and_swap(ptr_type expected_ptr, ptr_type new_ptr,
-                tag_type expected_tag, tag_type new_tag);
+                tag_type expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
+
+        /// Like compare_and_swap but on failure the observed pointer and tag
+        /// are written back to expected_ptr and expected_tag so that a retry
+        /// loop need not reload them. The weak form may fail spuriously.
+        bool compare_exchange_strong(ptr_type & expected_ptr, ptr_type new_ptr,
+                tag_type & expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
+        bool compare_exchange_weak(ptr_type & expected_ptr, ptr_type new_ptr,
+                tag_type & expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
 
     private:
         MPM_DISALLOW_COPY_AND_ASSIGN(atomic_tagged_ptr);
@@ -32,8 +46,11 @@ namespace mpm {
 
         raw_value_type pack(ptr_type ptr, tag_type tag) const;
         ptr_type unpack(raw_value_type raw, tag_type & tag_out) const;
+        bool compare_exchange(ptr_type & expected_ptr, ptr_type new_ptr,
+                tag_type & expected_tag, tag_type new_tag, bool weak,
+                memory_order order);
 
-        volatile raw_value_type m_raw_value;
+        raw_value_type m_raw_value;
     };
 
 
@@ -47,28 +64,69 @@ namespace mpm {
     template <typename T, typename Tag>
     bool
     atomic_tagged_ptr<T, Tag>::compare_and_swap(ptr_type expected_ptr,
-            ptr_type new_ptr, tag_type expected_tag, tag_type new_tag)
+            ptr_type new_ptr, tag_type expected_tag, tag_type new_tag,
+            memory_order order)
     {
         raw_value_type new_value(pack(new_ptr, new_tag));
         raw_value_type expected_value(pack(expected_ptr, expected_tag));
-        return MPM_CAS(&m_raw_value, expected_value, new_value);
+        return MPM_CAS_EXPLICIT(&m_raw_value, expected_value, new_value, order);
+    }
+
+
+    template <typename T, typename Tag>
+    bool
+    atomic_tagged_ptr<T, Tag>::compare_exchange_strong(
+            ptr_type & expected_ptr, ptr_type new_ptr,
+            tag_type & expected_tag, tag_type new_tag, memory_order order)
+    {
+        return compare_exchange(
+                expected_ptr, new_ptr, expected_tag, new_tag, false, order);
+    }
+
+
+    template <typename T, typename Tag>
+    bool
+    atomic_tagged_ptr<T, Tag>::compare_exchange_weak(
+            ptr_type & expected_ptr, ptr_type new_ptr,
+            tag_type & expected_tag, tag_type new_tag, memory_order order)
+    {
+        return compare_exchange(
+                expected_ptr, new_ptr, expected_tag, new_tag, true, order);
+    }
+
+
+    template <typename T, typename Tag>
+    bool
+    atomic_tagged_ptr<T, Tag>::compare_exchange(
+            ptr_type & expected_ptr, ptr_type new_ptr,
+            tag_type & expected_tag, tag_type new_tag, bool weak,
+            memory_order order)
+    {
+        raw_value_type expected_value(pack(expected_ptr, expected_tag));
+        if(MPM_COMPARE_EXCHANGE(&m_raw_value, &expected_value,
+                    pack(new_ptr, new_tag), weak, order))
+            return true;
+        expected_ptr = unpack(expected_value, expected_tag);
+        return false;
     }
 
 
     template <typename T, typename Tag>
     typename atomic_tagged_ptr<T, Tag>::ptr_type
-    atomic_tagged_ptr<T, Tag>::get(tag_type & tag_out) const
+    atomic_tagged_ptr<T, Tag>::get(
+            tag_type & tag_out, memory_order order) const
     {
-        return unpack(m_raw_value, tag_out);
+        return unpack(MPM_LOAD(&m_raw_value, order), tag_out);
     }
 
 
     template <typename T, typename Tag>
     void
-    atomic_tagged_ptr<T, Tag>::set(ptr_type ptr, tag_type tag)
+    atomic_tagged_ptr<T, Tag>::set(
+            ptr_type ptr, tag_type tag, memory_order order)
     {
         raw_value_type new_value(pack(ptr, tag));
-        MPM_EXCHG(&m_raw_value, new_value);
+        MPM_STORE(&m_raw_value, new_value, order);
     }
 
 
@@ -91,4 +149,139 @@ namespace mpm {
         return reinterpret_cast<ptr_type>(raw & 0x0000ffffffffffff);
     }
 
+
+
+#if defined(MPM_HAS_DWCAS)
+
+    /// Pairs a pointer with a full 64 bit tag and allows for atomic read,
+    /// write, and CAS on them using a double-width (16 byte) CAS. Select it
+    /// with atomic_tagged_ptr<T, uint64_t> where 65536 tag values are not
+    /// enough to rule out ABA.
+    ///
+    /// get() reads the tag and then the pointer as two separate loads so the
+    /// pair it returns may be torn. A torn pair can never satisfy a
+    /// subsequent compare_and_swap unless memory actually holds it, and as
+    /// long as every update moves the tag forward a successful
+    /// compare_and_swap also proves that the pointer has not changed since
+    /// the tag was read. The value written back by a failed
+    /// compare_exchange_* is never torn. Updates are always fully ordered;
+    /// their ordering arguments are accepted for interface compatibility.
+    template <typename T>
+    class atomic_tagged_ptr<T, uint64_t>
+    {
+    public:
+
+        typedef uint64_t tag_type;
+        typedef T*       ptr_type;
+        typedef T        value_type;
+
+        atomic_tagged_ptr(ptr_type ptr=0, tag_type tag=0);
+
+        ptr_type get(tag_type & tag_out,
+                memory_order order=memory_order_seq_cst) const;
+        void set(ptr_type ptr, tag_type tag,
+                memory_order order=memory_order_seq_cst);
+        bool compare_and_swap(ptr_type expected_ptr, ptr_type new_ptr,
+                tag_type expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
+        bool compare_exchange_strong(ptr_type & expected_ptr, ptr_type new_ptr,
+                tag_type & expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
+        bool compare_exchange_weak(ptr_type & expected_ptr, ptr_type new_ptr,
+                tag_type & expected_tag, tag_type new_tag,
+                memory_order order=memory_order_seq_cst);
+
+    private:
+        MPM_DISALLOW_COPY_AND_ASSIGN(atomic_tagged_ptr);
+
+        typedef detail::double_word raw_value_type;
+
+        static raw_value_type pack(ptr_type ptr, tag_type tag);
+
+        raw_value_type m_raw_value;
+    };
+
+
+    template <typename T>
+    atomic_tagged_ptr<T, uint64_t>::atomic_tagged_ptr(
+            ptr_type ptr, tag_type tag) :
+        m_raw_value(pack(ptr, tag))
+    {
+    }
+
+
+    template <typename T>
+    bool
+    atomic_tagged_ptr<T, uint64_t>::compare_and_swap(ptr_type expected_ptr,
+            ptr_type new_ptr, tag_type expected_tag, tag_type new_tag,
+            memory_order)
+    {
+        raw_value_type expected_value(pack(expected_ptr, expected_tag));
+        return MPM_DWCAS(&m_raw_value, &expected_value, pack(new_ptr, new_tag));
+    }
+
+
+    template <typename T>
+    bool
+    atomic_tagged_ptr<T, uint64_t>::compare_exchange_strong(
+            ptr_type & expected_ptr, ptr_type new_ptr,
+            tag_type & expected_tag, tag_type new_tag, memory_order)
+    {
+        raw_value_type expected_value(pack(expected_ptr, expected_tag));
+        if(MPM_DWCAS(&m_raw_value, &expected_value, pack(new_ptr, new_tag)))
+            return true;
+        expected_ptr = reinterpret_cast<ptr_type>(expected_value.lo);
+        expected_tag = expected_value.hi;
+        return false;
+    }
+
+
+    template <typename T>
+    bool
+    atomic_tagged_ptr<T, uint64_t>::compare_exchange_weak(
+            ptr_type & expected_ptr, ptr_type new_ptr,
+            tag_type & expected_tag, tag_type new_tag, memory_order order)
+    {
+        // cmpxchg16b never fails spuriously
+        return compare_exchange_strong(
+                expected_ptr, new_ptr, expected_tag, new_tag, order);
+    }
+
+
+    template <typename T>
+    typename atomic_tagged_ptr<T, uint64_t>::ptr_type
+    atomic_tagged_ptr<T, uint64_t>::get(
+            tag_type & tag_out, memory_order order) const
+    {
+        tag_out = MPM_LOAD(&m_raw_value.hi, order);
+        return reinterpret_cast<ptr_type>(MPM_LOAD(&m_raw_value.lo, order));
+    }
+
+
+    template <typename T>
+    void
+    atomic_tagged_ptr<T, uint64_t>::set(
+            ptr_type ptr, tag_type tag, memory_order)
+    {
+        // the two halves must change together so a CAS loop stands in for
+        // a double-width store
+        tag_type old_tag;
+        ptr_type old_ptr(get(old_tag, memory_order_relaxed));
+        while(!compare_exchange_strong(old_ptr, ptr, old_tag, tag))
+            ;
+    }
+
+
+    template <typename T>
+    typename atomic_tagged_ptr<T, uint64_t>::raw_value_type
+    atomic_tagged_ptr<T, uint64_t>::pack(ptr_type ptr, tag_type tag)
+    {
+        raw_value_type ret;
+        ret.lo = reinterpret_cast<uint64_t>(ptr);
+        ret.hi = tag;
+        return ret;
+    }
+
+#endif
+
 }
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/util.hpp"
+#include <sched.h>
+#include <stdint.h>
+
+namespace mpm {
+
+/// \file
+/// Backoff policies for lock-free retry and spin loops.
+///
+/// A policy is default constructed at the start of an operation and invoked
+/// with operator() each time an attempt fails, so it can keep whatever state
+/// it needs (e.g. a growing delay) for the duration of that one operation.
+
+
+/// Retries immediately
+struct no_backoff
+{
+    void operator()() {}
+};
+
+
+/// Executes a single cpu relax (pause on x86) between attempts
+struct pause_backoff
+{
+    void operator()() { MPM_CPU_RELAX(); }
+};
+
+
+/// \brief Truncated exponential backoff with jitter
+///
+/// The n'th invocation spins for a random number of cpu relax instructions
+/// in [limit/2, limit] where limit starts at MinSpins and doubles on each
+/// invocation until it reaches MaxSpins. The jitter keeps threads that
+/// collided once from colliding again in lock step.
+template <unsigned int MinSpins=4, unsigned int MaxSpins=1024>
+class exponential_backoff
+{
+public:
+    exponential_backoff() :
+        m_limit(MinSpins),
+        m_seed(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)) | 1u)
+    {
+    }
+
+    void operator()()
+    {
+        // xorshift32
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+
+        unsigned int half(m_limit / 2);
+        unsigned int spins(half + m_seed % (m_limit - half + 1));
+        for(unsigned int i = 0; i < spins; i++)
+            MPM_CPU_RELAX();
+
+        if(m_limit < MaxSpins)
+            m_limit = m_limit * 2 < MaxSpins ? m_limit * 2 : MaxSpins;
+    }
+
+private:
+    MPM_STATIC_ASSERT(MinSpins > 0 && MinSpins <= MaxSpins);
+
+    unsigned int m_limit;
+    uint32_t m_seed;
+};
+
+
+/// \brief Spins with cpu relax for the first Spins invocations and then
+/// yields the processor on each subsequent one
+///
+/// Useful when threads outnumber cores and the thread we are waiting on may
+/// not currently be scheduled.
+template <unsigned int Spins=64>
+class spin_then_yield_backoff
+{
+public:
+    spin_then_yield_backoff() : m_count(0) {}
+
+    void operator()()
+    {
+        if(m_count < Spins)
+        {
+            m_count++;
+            MPM_CPU_RELAX();
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+private:
+    unsigned int m_count;
+};
+
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/util.hpp"
+#include <cstddef>
+
+namespace mpm {
+
+/// \brief A bounded lock-free MPMC queue that stores values in a ring
+///
+/// Cribbed from
+/// [Dmitry Vyukov](http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue).
+/// As in bounded_mpsc_ring, each of the Capacity cells carries a sequence
+/// number: a producer may write cell i (mod Capacity) of round r once its
+/// sequence is i + r * Capacity and a consumer may read it once it is one
+/// more than that, after which the consumer hands it on to the next round.
+/// Producers claim positions from a shared tail and consumers from a shared
+/// head, each with a CAS that is only attempted once the cell at that
+/// position is ready, so a full or empty queue is detected without
+/// touching the other side's counter.
+///
+/// Any number of threads may push and pop concurrently. T must be default
+/// constructible and assignable. Capacity must be a power of two.
+template <typename T, std::size_t Capacity>
+class bounded_mpmc_queue
+{
+public:
+
+    typedef T value_type;
+
+    static const std::size_t capacity = Capacity;
+
+    bounded_mpmc_queue();
+
+    /// \brief Copies value into the queue if there is room. Does not block.
+    /// \returns false if the queue was full
+    bool try_push(const value_type& value);
+
+    /// \brief Moves the value at the front of the queue into out. Does not
+    /// block.
+    /// \returns false if the queue was empty or if the producer that holds
+    ///          the front position has not finished writing to it yet
+    bool try_pop(value_type& out);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(bounded_mpmc_queue);
+    MPM_STATIC_ASSERT(Capacity > 0 && 0 == (Capacity & (Capacity - 1)));
+
+    static const std::size_t mask = Capacity - 1;
+
+    struct cell
+    {
+        std::size_t sequence;
+        value_type value;
+    };
+
+    // claims the next position from position (the tail or the head) once
+    // its cell's sequence reaches pos + lag, leaving the position in pos
+    // and returning the cell; returns NULL if the cell is not ready yet
+    cell* claim(std::size_t& position, std::size_t& pos, std::size_t lag);
+
+    cache_padded<std::size_t> m_tail;
+    cache_padded<std::size_t> m_head;
+    cell m_cells[Capacity];
+};
+
+
+template <typename T, std::size_t C>
+const std::size_t bounded_mpmc_queue<T, C>::capacity;
+
+
+template <typename T, std::size_t C>
+bounded_mpmc_queue<T, C>::bounded_mpmc_queue() :
+    m_tail(std::size_t(0)), m_head(std::size_t(0))
+{
+    for(std::size_t i = 0; i < C; i++)
+        m_cells[i].sequence = i;
+}
+
+
+template <typename T, std::size_t C>
+bool
+bounded_mpmc_queue<T, C>::try_push(const value_type& value)
+{
+    std::size_t pos;
+    cell* c(claim(*m_tail, pos, 0));
+    if(!c)
+        return false;
+    c->value = value;
+    // release publishes the value to the consumer of this round
+    MPM_STORE(&c->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+
+template <typename T, std::size_t C>
+bool
+bounded_mpmc_queue<T, C>::try_pop(value_type& out)
+{
+    std::size_t pos;
+    cell* c(claim(*m_head, pos, 1));
+    if(!c)
+        return false;
+    out = c->value;
+    // release hands the emptied cell to the producer of the next round
+    MPM_STORE(&c->sequence, pos + C, memory_order_release);
+    return true;
+}
+
+
+template <typename T, std::size_t C>
+typename bounded_mpmc_queue<T, C>::cell*
+bounded_mpmc_queue<T, C>::claim(
+        std::size_t& position, std::size_t& pos, std::size_t lag)
+{
+    pos = MPM_LOAD(&position, memory_order_relaxed);
+    while(true)
+    {
+        cell& c(m_cells[pos & mask]);
+        // acquire pairs with the release that made the cell ready, so that
+        // a producer sees the last consumer done with it and a consumer
+        // sees the value written to it
+        std::size_t sequence(MPM_LOAD(&c.sequence, memory_order_acquire));
+        std::ptrdiff_t diff(std::ptrdiff_t(sequence - (pos + lag)));
+        if(0 == diff)
+        {
+            // a failed CAS leaves the position it saw in pos
+            if(MPM_COMPARE_EXCHANGE(&position, &pos, pos + 1, true,
+                        memory_order_relaxed))
+                return &c;
+        }
+        else if(diff < 0)
+            // full for a producer, empty for a consumer
+            return NULL;
+        else
+            // another thread claimed pos; catch up
+            pos = MPM_LOAD(&position, memory_order_relaxed);
+    }
+}
+
+}
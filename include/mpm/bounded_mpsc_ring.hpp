@@ -0,0 +1,184 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/backoff.hpp"
+#include "mpm/util.hpp"
+#include <cstddef>
+
+namespace mpm {
+
+/// \brief A bounded lock-free MPSC queue that stores values in a ring
+///
+/// Unlike intrusive_lockfree_mpsc_queue, values are copied in and out and
+/// live in an array of Capacity cells, so the consumer drains memory
+/// sequentially and producers see the queue fill up rather than letting it
+/// grow without bound behind a stalled consumer.
+///
+/// Each cell carries a sequence number that says whose turn it is: a
+/// producer may write cell i (mod Capacity) of round r once its sequence is
+/// i + r * Capacity, and the consumer may read it once it is one more than
+/// that. Producers take positions from a shared tail:
+///  - try_push() claims the next position with a CAS only when its cell is
+///    free, so it never waits and fails when the ring is full;
+///  - push() takes a ticket with a fetch-add, which always succeeds, and
+///    then waits, invoking Backoff, for the consumer to free its cell.
+/// The consumer's position is its own and is never shared with producers.
+///
+/// T must be default constructible and assignable. Capacity must be a power
+/// of two.
+template <typename T, std::size_t Capacity,
+         typename Backoff=spin_then_yield_backoff<> >
+class bounded_mpsc_ring
+{
+public:
+
+    typedef T value_type;
+    typedef Backoff backoff_type;
+
+    static const std::size_t capacity = Capacity;
+
+    bounded_mpsc_ring();
+
+    /// \brief Copies value into the queue if there is room. Does not block.
+    /// \returns false if the queue was full
+    bool try_push(const value_type& value);
+
+    /// \brief Copies value into the queue, waiting for the consumer to make
+    /// room if the queue is full
+    void push(const value_type& value);
+
+    /// \brief Moves the value at the front of the queue into out. Does not
+    /// block; only the consumer may call it.
+    ///
+    /// \returns false if *this is empty or if the producer that holds the
+    ///          front position has not finished writing to it yet
+    bool pop(value_type& out);
+
+    /// \brief Pops up to max values from the front of the queue into out, in
+    /// FIFO order. Does not block; only the consumer may call it.
+    ///
+    /// \returns the number of values popped
+    template <typename OutputIterator>
+    std::size_t pop_bulk(OutputIterator out, std::size_t max);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(bounded_mpsc_ring);
+    MPM_STATIC_ASSERT(Capacity > 0 && 0 == (Capacity & (Capacity - 1)));
+
+    static const std::size_t mask = Capacity - 1;
+
+    struct cell
+    {
+        std::size_t sequence;
+        value_type value;
+    };
+
+    void publish(cell& c, std::size_t pos, const value_type& value);
+
+    cache_padded<std::size_t> m_tail;
+    cache_padded<std::size_t> m_head;
+    cell m_cells[Capacity];
+};
+
+
+template <typename T, std::size_t C, typename B>
+const std::size_t bounded_mpsc_ring<T, C, B>::capacity;
+
+
+template <typename T, std::size_t C, typename B>
+bounded_mpsc_ring<T, C, B>::bounded_mpsc_ring() :
+    m_tail(std::size_t(0)), m_head(std::size_t(0))
+{
+    for(std::size_t i = 0; i < C; i++)
+        m_cells[i].sequence = i;
+}
+
+
+template <typename T, std::size_t C, typename B>
+bool
+bounded_mpsc_ring<T, C, B>::try_push(const value_type& value)
+{
+    std::size_t pos(MPM_LOAD(&*m_tail, memory_order_relaxed));
+    while(true)
+    {
+        cell& c(m_cells[pos & mask]);
+        // acquire pairs with the release in pop_bulk so that the consumer has
+        // finished reading the cell before we overwrite it
+        std::size_t sequence(MPM_LOAD(&c.sequence, memory_order_acquire));
+        std::ptrdiff_t diff(std::ptrdiff_t(sequence - pos));
+        if(0 == diff)
+        {
+            // the cell is free; claim its position. A failed CAS leaves
+            // the tail it saw in pos.
+            if(MPM_COMPARE_EXCHANGE(&*m_tail, &pos, pos + 1, true,
+                        memory_order_relaxed))
+            {
+                publish(c, pos, value);
+                return true;
+            }
+        }
+        else if(diff < 0)
+            // the consumer has not emptied the cell since the last round
+            return false;
+        else
+            // another producer claimed pos; catch up
+            pos = MPM_LOAD(&*m_tail, memory_order_relaxed);
+    }
+}
+
+
+template <typename T, std::size_t C, typename B>
+void
+bounded_mpsc_ring<T, C, B>::push(const value_type& value)
+{
+    std::size_t pos(MPM_FETCH_ADD(&*m_tail, std::size_t(1),
+                memory_order_relaxed));
+    cell& c(m_cells[pos & mask]);
+    B backoff;
+    while(pos != MPM_LOAD(&c.sequence, memory_order_acquire))
+        backoff();
+    publish(c, pos, value);
+}
+
+
+template <typename T, std::size_t C, typename B>
+void
+bounded_mpsc_ring<T, C, B>::publish(
+        cell& c, std::size_t pos, const value_type& value)
+{
+    c.value = value;
+    // release publishes the value to the consumer
+    MPM_STORE(&c.sequence, pos + 1, memory_order_release);
+}
+
+
+template <typename T, std::size_t C, typename B>
+bool
+bounded_mpsc_ring<T, C, B>::pop(value_type& out)
+{
+    return 1 == pop_bulk(&out, 1);
+}
+
+
+template <typename T, std::size_t C, typename B>
+template <typename OutputIterator>
+std::size_t
+bounded_mpsc_ring<T, C, B>::pop_bulk(OutputIterator out, std::size_t max)
+{
+    std::size_t pos(*m_head);
+    std::size_t count(0);
+    for(; count < max; count++, pos++)
+    {
+        cell& c(m_cells[pos & mask]);
+        // acquire pairs with the release in publish
+        if(pos + 1 != MPM_LOAD(&c.sequence, memory_order_acquire))
+            break;
+        *out++ = c.value;
+        // release hands the emptied cell to the producer of the next round
+        MPM_STORE(&c.sequence, pos + C, memory_order_release);
+    }
+    *m_head = pos;
+    return count;
+}
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/util.hpp"
+#include <cassert>
+#include <stdint.h>
+#include <time.h>
+
+namespace mpm {
+
+/// \file
+/// Deadlines for spin loops that give up after a while.
+///
+/// A deadline is constructed from a timeout when a wait begins and its
+/// expired() is called once per spin; the wait ends the first time it
+/// returns true.
+
+
+/// \brief Expires after a fixed number of spins
+///
+/// Cheapest to check, but how long a spin takes varies with the cpu, its
+/// frequency and the backoff policy in use.
+class spin_deadline
+{
+public:
+    explicit spin_deadline(unsigned int spins) : m_spins(spins) {}
+
+    bool expired()
+    {
+        if(0 == m_spins)
+            return true;
+        m_spins--;
+        return false;
+    }
+
+private:
+    unsigned int m_spins;
+};
+
+
+namespace detail {
+
+    inline uint64_t monotonic_ns()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+    }
+
+
+    /// \returns the time stamp counter where there is one, otherwise
+    ///          monotonic nanoseconds
+    inline uint64_t read_tsc()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        uint32_t lo, hi;
+        __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+        return (uint64_t(hi) << 32) | lo;
+#else
+        return monotonic_ns();
+#endif
+    }
+
+
+    /// Times read_tsc() against the monotonic clock over a few milliseconds
+    inline double measure_tsc_cycles_per_ns()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        static const uint64_t window_ns = 5000000;
+        uint64_t start_ns(monotonic_ns()), start_tsc(read_tsc());
+        uint64_t end_ns;
+        do
+        {
+            end_ns = monotonic_ns();
+        } while(end_ns - start_ns < window_ns);
+        uint64_t end_tsc(read_tsc());
+        return double(end_tsc - start_tsc) / double(end_ns - start_ns);
+#else
+        return 1.0;
+#endif
+    }
+
+
+    // the rate measured by calibrate_tsc(); NULL until it has been called
+    inline const double*& tsc_rate()
+    {
+        static const double* rate(0);
+        return rate;
+    }
+}
+
+
+/// \brief Measures how many read_tsc() ticks elapse per nanosecond
+///
+/// Spins for about 5ms the first time it is called and returns the cached
+/// rate at once after that. Call it at startup, before any thread builds a
+/// tsc_deadline, so that the measurement never lands inside a timed wait.
+/// The time stamp counter must be invariant (constant rate and synchronized
+/// across cores), as it is on every x86 cpu of the last decade.
+///
+/// \returns the measured rate
+inline double calibrate_tsc()
+{
+    static const double cycles_per_ns(detail::measure_tsc_cycles_per_ns());
+    MPM_STORE(&detail::tsc_rate(), &cycles_per_ns, memory_order_release);
+    return cycles_per_ns;
+}
+
+
+/// \returns the rate measured by calibrate_tsc(), which must have been
+///          called; never measures it itself. Returns 0 if uncalibrated,
+///          which makes every tsc_deadline expire at once.
+inline double tsc_cycles_per_ns()
+{
+    const double* rate(MPM_LOAD(&detail::tsc_rate(), memory_order_acquire));
+    assert(rate && "call mpm::calibrate_tsc() at startup");
+    return rate ? *rate : 0.0;
+}
+
+
+/// \brief Expires once a number of nanoseconds have passed, measured with
+/// the time stamp counter
+///
+/// Lets a timeout be tuned once and mean the same thing across hardware.
+/// Checking costs a read of the time stamp counter per spin. Construction
+/// only reads the rate cached by calibrate_tsc(), which must be called at
+/// startup.
+class tsc_deadline
+{
+public:
+    explicit tsc_deadline(unsigned int ns) :
+        m_end(detail::read_tsc() + uint64_t(ns * tsc_cycles_per_ns()))
+    {
+    }
+
+    bool expired()
+    {
+        return detail::read_tsc() >= m_end;
+    }
+
+private:
+    uint64_t m_end;
+};
+
+}
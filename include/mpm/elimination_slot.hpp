@@ -0,0 +1,185 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/atomic_tagged_ptr.hpp"
+#include "mpm/backoff.hpp"
+#include "mpm/deadline.hpp"
+#include "mpm/lockfree_exchanger.hpp"
+#include "mpm/util.hpp"
+#include <cassert>
+
+namespace mpm {
+
+/// \brief A rendezvous point where a push can hand a pointer to a pop
+///
+/// Unlike lockfree_exchanger, the slot records which operation is waiting
+/// in it, so a push only ever pairs with a pop and vice versa. A thread that
+/// finds the same operation already waiting returns exchange_contended
+/// immediately instead of spending its timeout on a partner it cannot use.
+///
+/// Backoff is invoked on every spin while waiting for a partner and while
+/// waiting out two other threads that are mid-handoff; see backoff.hpp.
+/// Timeouts are either a number of spins or a deadline; see deadline.hpp.
+template <typename T, typename Backoff=no_backoff>
+class elimination_slot
+{
+public:
+    typedef T         value_type;
+    typedef T*        ptr_type;
+    typedef ptr_type& ref_ptr_type;
+
+    elimination_slot();
+
+    /// \brief Offers my_ptr to a concurrent pop for up to timeout spins
+    exchange_result push(ptr_type my_ptr, unsigned int timeout);
+
+    /// \brief Waits up to timeout spins to take a pointer from a concurrent
+    /// push; out_val receives it on success
+    exchange_result pop(ref_ptr_type out_val, unsigned int timeout);
+
+    /// \brief As push() but waits until deadline expires; see deadline.hpp
+    template <typename Deadline>
+    exchange_result push_until(ptr_type my_ptr, Deadline deadline);
+
+    /// \brief As pop() but waits until deadline expires; see deadline.hpp
+    template <typename Deadline>
+    exchange_result pop_until(ref_ptr_type out_val, Deadline deadline);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(elimination_slot);
+    enum {
+        EMPTY,          //No thread is waiting in the slot
+
+        WAITING_PUSH,   //A pusher has posted its pointer and awaits a popper
+
+        WAITING_POP,    //A popper awaits a pusher
+
+        BUSY,           //A partner has arrived and the waiting thread has not
+                        //yet reset the slot
+    };
+
+    typedef typename atomic_tagged_ptr<value_type>::tag_type tag_type;
+
+    template <typename Deadline>
+    exchange_result rendezvous(ptr_type my_ptr, ref_ptr_type out_val,
+            tag_type mine, tag_type partner, Deadline& deadline);
+
+    atomic_tagged_ptr<value_type> m_slot;
+};
+
+
+template <typename T, typename B>
+elimination_slot<T, B>::elimination_slot() : m_slot(0, EMPTY)
+{
+}
+
+
+template <typename T, typename B>
+exchange_result
+elimination_slot<T, B>::push(ptr_type my_ptr, unsigned int timeout)
+{
+    return push_until(my_ptr, spin_deadline(timeout));
+}
+
+
+template <typename T, typename B>
+exchange_result
+elimination_slot<T, B>::pop(ref_ptr_type out_val, unsigned int timeout)
+{
+    return pop_until(out_val, spin_deadline(timeout));
+}
+
+
+template <typename T, typename B>
+template <typename Deadline>
+exchange_result
+elimination_slot<T, B>::push_until(ptr_type my_ptr, Deadline deadline)
+{
+    ptr_type unused(0);
+    return rendezvous(my_ptr, unused, WAITING_PUSH, WAITING_POP, deadline);
+}
+
+
+template <typename T, typename B>
+template <typename Deadline>
+exchange_result
+elimination_slot<T, B>::pop_until(ref_ptr_type out_val, Deadline deadline)
+{
+    return rendezvous(0, out_val, WAITING_POP, WAITING_PUSH, deadline);
+}
+
+
+template <typename T, typename B>
+template <typename Deadline>
+exchange_result
+elimination_slot<T, B>::rendezvous(ptr_type my_ptr, ref_ptr_type out_val,
+        tag_type mine, tag_type partner, Deadline& deadline)
+{
+    tag_type tag;
+    B backoff;
+
+    // acquire so that a waiting pusher's pointer is safe to hand back.
+    // Failed CAS attempts below write the observed slot back into
+    // existing_ptr and tag so the slot is only reloaded when there is
+    // nothing to CAS against.
+    ptr_type existing_ptr(m_slot.get(tag, memory_order_acquire));
+    while(!deadline.expired())
+    {
+        if(EMPTY == tag)
+        {
+            // release to publish my_ptr to the popper that picks it up
+            if(!m_slot.compare_exchange_weak(existing_ptr, my_ptr, tag, mine,
+                        memory_order_release))
+                continue;
+            do
+            {
+                existing_ptr = m_slot.get(tag, memory_order_acquire);
+                if(BUSY == tag)
+                {
+                    // a partner has arrived; a pusher left its pointer
+                    // behind for us
+                    m_slot.set(0, EMPTY, memory_order_relaxed);
+                    out_val = existing_ptr;
+                    return exchange_success;
+                }
+                backoff();
+            } while(!deadline.expired());
+            // done spinning without a partner. This must be a strong CAS as
+            // a failure means a partner has arrived.
+            existing_ptr = my_ptr;
+            tag = mine;
+            if(m_slot.compare_exchange_strong(existing_ptr, 0, tag, EMPTY,
+                        memory_order_acquire))
+                return exchange_timeout;
+            out_val = existing_ptr;
+            m_slot.set(0, EMPTY, memory_order_relaxed);
+            return exchange_success;
+        }
+        else if(partner == tag)
+        {
+            // acq_rel: acquire a waiting pusher's pointer or release ours to
+            // a waiting popper
+            if(m_slot.compare_exchange_weak(existing_ptr, my_ptr, tag, BUSY,
+                        memory_order_acq_rel))
+            {
+                out_val = existing_ptr;
+                return exchange_success;
+            }
+        }
+        else if(mine == tag)
+        {
+            // the same operation is already waiting here and can never be
+            // our partner
+            return exchange_contended;
+        }
+        else
+        {
+            assert(BUSY == tag);
+            backoff();
+            existing_ptr = m_slot.get(tag, memory_order_acquire);
+        }
+    }
+    return exchange_contended;
+}
+
+}
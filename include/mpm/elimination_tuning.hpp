@@ -0,0 +1,397 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/deadline.hpp"
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "mpm/util.hpp"
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+namespace mpm {
+
+/// \brief Leaves runtime elimination parameters alone
+///
+/// A tuner is a member of runtime_elimination_opts::params and provides a
+/// nested template operation<Params>, constructed from the params at the
+/// start of every stack operation, which is told of each failed CAS on the
+/// top of the stack (cas_failed()) and of the result of each elimination
+/// attempt (eliminated(result)).
+struct no_elimination_tuning
+{
+    template <typename Params>
+    class operation
+    {
+    public:
+        explicit operation(Params&) {}
+        void cas_failed() {}
+        void eliminated(exchange_result) {}
+    };
+};
+
+
+/// \brief Hill-climbs runtime elimination parameters towards the highest
+/// throughput
+///
+/// One operation in 2^SampleShift, chosen at random by each thread, is
+/// sampled: the CAS failures, elimination attempts and elimination hits it
+/// saw are added to counters shared by the stack. The thread that completes
+/// a window of Window sampled operations measures how quickly the window
+/// went by, compares that with the previous window and moves one parameter
+/// (slot count, timeout or attempts, in turn) a step up or down, turning
+/// around whenever a step made things worse.
+///
+/// The counters share a single cache line that every sampled operation,
+/// from every thread, writes to; sampling keeps that traffic to a fraction
+/// of the stack's own. The hit and CAS failure rates of the last window are
+/// kept for inspection.
+template <unsigned int SampleShift=4, unsigned int Window=256>
+class elimination_autotuner
+{
+public:
+
+    template <typename Params>
+    class operation
+    {
+    public:
+        explicit operation(Params& params) :
+            m_params(params), m_cas_failures(0), m_attempts(0), m_hits(0)
+        {
+        }
+
+        ~operation()
+        {
+            if(sampled())
+                m_params.tuner().sample(
+                        m_params, m_cas_failures, m_attempts, m_hits);
+        }
+
+        void cas_failed() { m_cas_failures++; }
+
+        void eliminated(exchange_result result)
+        {
+            m_attempts++;
+            if(exchange_success == result)
+                m_hits++;
+        }
+
+    private:
+        MPM_DISALLOW_COPY_AND_ASSIGN(operation);
+
+        static bool sampled()
+        {
+            static __thread uint32_t state;
+            uint32_t x(state ? state : detail::thread_seed());
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            state = x;
+            return 0 == (x & ((1u << SampleShift) - 1));
+        }
+
+        Params& m_params;
+        unsigned int m_cas_failures;
+        unsigned int m_attempts;
+        unsigned int m_hits;
+    };
+
+    elimination_autotuner();
+
+    /// \returns the fraction of elimination attempts in the last window that
+    ///          met a partner
+    double hit_rate() const;
+
+    /// \returns the fraction of CAS attempts on the top of the stack in the
+    ///          last window that failed
+    double cas_failure_rate() const;
+
+    /// \returns the number of windows completed so far
+    unsigned int windows() const;
+
+    /// \brief Accounts for one sampled operation; called by operation
+    template <typename Params>
+    void sample(Params& params, unsigned int cas_failures,
+            unsigned int attempts, unsigned int hits);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(elimination_autotuner);
+    MPM_STATIC_ASSERT(Window > 0 && SampleShift < 32);
+
+    enum dimension { SLOTS, TIMEOUT, ATTEMPTS, DIMENSIONS };
+
+    // added to the window's op count by the thread closing it
+    static const unsigned int closing = 1u << 31;
+
+    template <typename Params>
+    void step(Params& params, unsigned int ops, uint64_t ticks);
+
+    struct counters
+    {
+        unsigned int ops;
+        unsigned int cas_failures;
+        unsigned int attempts;
+        unsigned int hits;
+    };
+
+    // written by every sampled operation, from every thread
+    cache_padded<counters> m_counters;
+
+    // only touched by the thread that completes a window
+    uint64_t m_window_start;
+    double m_last_throughput;
+    unsigned int m_dimension;
+    int m_direction[DIMENSIONS];
+
+    // results of the last window, read by anyone
+    unsigned int m_last_ops;
+    unsigned int m_last_cas_failures;
+    unsigned int m_last_attempts;
+    unsigned int m_last_hits;
+    unsigned int m_windows;
+};
+
+
+/// \brief Elimination options whose slot count, timeout and attempts can be
+/// changed while a stack is in use
+///
+/// Use in place of elimination_opts where the right parameters are not known
+/// at compile time. MaxSlots elimination slots are allocated and the
+/// parameters are read from the stack's elimination_parameters() at the
+/// start of every elimination. Tuner may adjust them automatically; see
+/// elimination_autotuner. Range, Selector and Deadline are as for
+/// elimination_opts.
+template <std::size_t MaxSlots, typename Tuner=no_elimination_tuning,
+         typename Range=fixed_elimination_range,
+         typename Selector=random_slot_selector,
+         typename Deadline=spin_deadline>
+struct runtime_elimination_opts
+{
+    /// the number of elimination slots allocated
+    static const std::size_t slots = MaxSlots;
+
+    /// whether elimination is compiled in at all
+    static const bool enabled = MaxSlots != 0;
+
+    typedef Range range_policy;
+    typedef Selector slot_selector;
+    typedef Deadline deadline_type;
+    typedef Tuner tuner_type;
+
+    class params
+    {
+    public:
+        typedef typename Tuner::template operation<params> operation;
+
+        static const std::size_t max_slots = MaxSlots;
+
+        params() : m_slots(MaxSlots), m_timeout(500), m_attempts(2) {}
+
+        /// the number of slots in use; a power of two no greater than
+        /// MaxSlots
+        std::size_t slots() const
+        {
+            return MPM_LOAD(&m_slots, memory_order_relaxed);
+        }
+
+        /// how long to stay in each elimination attempt, in the units of
+        /// Deadline
+        unsigned int timeout() const
+        {
+            return MPM_LOAD(&m_timeout, memory_order_relaxed);
+        }
+
+        /// the number of elimination attempts before going back to the
+        /// central stack; 0 turns elimination off
+        unsigned int attempts() const
+        {
+            return MPM_LOAD(&m_attempts, memory_order_relaxed);
+        }
+
+        void set_slots(std::size_t slots)
+        {
+            assert(0 < slots && slots <= MaxSlots);
+            assert(0 == (slots & (slots - 1)));
+            MPM_STORE(&m_slots, slots, memory_order_relaxed);
+        }
+
+        void set_timeout(unsigned int timeout)
+        {
+            MPM_STORE(&m_timeout, timeout, memory_order_relaxed);
+        }
+
+        void set_attempts(unsigned int attempts)
+        {
+            MPM_STORE(&m_attempts, attempts, memory_order_relaxed);
+        }
+
+        Tuner& tuner() { return m_tuner; }
+        const Tuner& tuner() const { return m_tuner; }
+
+    private:
+        MPM_DISALLOW_COPY_AND_ASSIGN(params);
+        MPM_STATIC_ASSERT(0 == (MaxSlots & (MaxSlots - std::size_t(1u))));
+
+        std::size_t m_slots;
+        unsigned int m_timeout;
+        unsigned int m_attempts;
+        Tuner m_tuner;
+    };
+};
+
+
+template <unsigned int S, unsigned int W>
+const unsigned int elimination_autotuner<S, W>::closing;
+
+
+template <unsigned int S, unsigned int W>
+elimination_autotuner<S, W>::elimination_autotuner() :
+    m_window_start(detail::read_tsc()), m_last_throughput(0),
+    m_dimension(SLOTS), m_last_ops(0), m_last_cas_failures(0),
+    m_last_attempts(0), m_last_hits(0), m_windows(0)
+{
+    counters zero = { 0, 0, 0, 0 };
+    *m_counters = zero;
+    for(unsigned int i = 0; i < DIMENSIONS; i++)
+        m_direction[i] = -1;
+}
+
+
+template <unsigned int S, unsigned int W>
+double
+elimination_autotuner<S, W>::hit_rate() const
+{
+    unsigned int attempts(MPM_LOAD(&m_last_attempts, memory_order_relaxed));
+    unsigned int hits(MPM_LOAD(&m_last_hits, memory_order_relaxed));
+    return attempts ? double(hits) / attempts : 0.0;
+}
+
+
+template <unsigned int S, unsigned int W>
+double
+elimination_autotuner<S, W>::cas_failure_rate() const
+{
+    // every operation that did not eliminate ended with a successful CAS
+    unsigned int ops(MPM_LOAD(&m_last_ops, memory_order_relaxed));
+    unsigned int hits(MPM_LOAD(&m_last_hits, memory_order_relaxed));
+    unsigned int failures(
+            MPM_LOAD(&m_last_cas_failures, memory_order_relaxed));
+    unsigned int cas(failures + ops - (hits < ops ? hits : ops));
+    return cas ? double(failures) / cas : 0.0;
+}
+
+
+template <unsigned int S, unsigned int W>
+unsigned int
+elimination_autotuner<S, W>::windows() const
+{
+    return MPM_LOAD(&m_windows, memory_order_relaxed);
+}
+
+
+template <unsigned int S, unsigned int W>
+template <typename Params>
+void
+elimination_autotuner<S, W>::sample(Params& params, unsigned int cas_failures,
+        unsigned int attempts, unsigned int hits)
+{
+    counters& c(*m_counters);
+    if(cas_failures)
+        MPM_FETCH_ADD(&c.cas_failures, cas_failures, memory_order_relaxed);
+    if(attempts)
+        MPM_FETCH_ADD(&c.attempts, attempts, memory_order_relaxed);
+    if(hits)
+        MPM_FETCH_ADD(&c.hits, hits, memory_order_relaxed);
+    // the window is full once ops reaches W. The thread whose CAS swaps ops
+    // for the closing mark owns the window; the others see it full or
+    // already marked and go on counting. Acquire pairs with the release
+    // below so that the owner sees the last owner's climbing state.
+    unsigned int ops(MPM_FETCH_ADD(&c.ops, 1u, memory_order_relaxed) + 1);
+    do
+    {
+        if(ops < W || ops >= closing)
+            return;
+    }
+    while(!MPM_COMPARE_EXCHANGE(&c.ops, &ops, closing, true,
+                memory_order_acquire));
+
+    // counts sampled from here on belong to the next window, like the ops
+    // that pile up on top of the mark
+    unsigned int cas(MPM_EXCHG_EXPLICIT(&c.cas_failures, 0u,
+                memory_order_relaxed));
+    unsigned int tries(MPM_EXCHG_EXPLICIT(&c.attempts, 0u,
+                memory_order_relaxed));
+    unsigned int hit(MPM_EXCHG_EXPLICIT(&c.hits, 0u, memory_order_relaxed));
+
+    uint64_t now(detail::read_tsc());
+    uint64_t ticks(now - m_window_start);
+    m_window_start = now;
+
+    MPM_STORE(&m_last_ops, ops, memory_order_relaxed);
+    MPM_STORE(&m_last_cas_failures, cas, memory_order_relaxed);
+    MPM_STORE(&m_last_attempts, tries, memory_order_relaxed);
+    MPM_STORE(&m_last_hits, hit, memory_order_relaxed);
+    step(params, ops, ticks);
+    MPM_STORE(&m_windows, m_windows + 1, memory_order_relaxed);
+
+    // take the mark off, keeping the ops counted meanwhile; release so that
+    // the next owner sees our climbing state
+    MPM_FETCH_ADD(&c.ops, -closing, memory_order_release);
+}
+
+
+template <unsigned int S, unsigned int W>
+template <typename Params>
+void
+elimination_autotuner<S, W>::step(Params& params, unsigned int ops,
+        uint64_t ticks)
+{
+    static const unsigned int min_timeout = 16;
+    static const unsigned int max_timeout = 1u << 20;
+    static const unsigned int max_attempts = 8;
+
+    double throughput(ticks ? double(ops) / ticks : 0.0);
+    if(throughput < m_last_throughput)
+    {
+        // the last step made things worse; head back the other way and
+        // try another parameter
+        m_direction[m_dimension] = -m_direction[m_dimension];
+        m_dimension = (m_dimension + 1) % DIMENSIONS;
+    }
+    m_last_throughput = throughput;
+
+    bool up(m_direction[m_dimension] > 0);
+    switch(m_dimension)
+    {
+        case SLOTS:
+        {
+            std::size_t slots(params.slots());
+            if(up && slots * 2 <= Params::max_slots)
+                params.set_slots(slots * 2);
+            else if(!up && slots > 1)
+                params.set_slots(slots / 2);
+            break;
+        }
+        case TIMEOUT:
+        {
+            unsigned int timeout(params.timeout());
+            if(up && timeout <= max_timeout / 2)
+                params.set_timeout(timeout * 2);
+            else if(!up && timeout >= min_timeout * 2)
+                params.set_timeout(timeout / 2);
+            break;
+        }
+        case ATTEMPTS:
+        {
+            unsigned int attempts(params.attempts());
+            if(up && attempts < max_attempts)
+                params.set_attempts(attempts + 1);
+            else if(!up && attempts > 1)
+                params.set_attempts(attempts - 1);
+            break;
+        }
+        default:
+            assert(false);
+    }
+}
+
+}
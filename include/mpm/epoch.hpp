@@ -0,0 +1,303 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/atomic_tagged_ptr.hpp"
+#include "mpm/reclamation.hpp"
+#include "mpm/util.hpp"
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace mpm {
+
+namespace detail {
+
+    /// Per-thread state within an epoch_domain. The announcement packs the
+    /// epoch the thread entered its critical section in with a low "active"
+    /// bit. Retired objects are kept in three limbo lists indexed by the
+    /// epoch they were retired in.
+    struct epoch_record
+    {
+        enum { generations = 3 };
+
+        epoch_record() :
+            active(true), announcement(0), nesting(0), retired_count(0), next(0)
+        {
+            for(std::size_t i = 0; i < generations; i++)
+                limbo_epoch[i] = 0;
+        }
+
+        ~epoch_record()
+        {
+            for(std::size_t i = 0; i < generations; i++)
+                free_limbo(i);
+        }
+
+        void on_thread_exit()
+        {
+            nesting = 0;
+            MPM_STORE(&announcement, uint64_t(0), memory_order_release);
+        }
+
+        void free_limbo(std::size_t generation)
+        {
+            std::vector<retired_ptr>& list(limbo[generation]);
+            for(std::size_t i = 0; i < list.size(); i++)
+                list[i].deleter(list[i].ptr);
+            list.clear();
+        }
+
+        bool active;
+        uint64_t announcement;
+
+        // only ever touched by the owning thread
+        unsigned int nesting;
+        std::size_t retired_count;
+        uint64_t limbo_epoch[generations];
+        std::vector<retired_ptr> limbo[generations];
+
+        epoch_record* next;
+    };
+}
+
+
+/// \brief Epoch-based reclamation
+///
+/// Threads bracket each operation on a shared datastructure with
+/// enter()/exit() (or an epoch_guard). An object retired while the global
+/// epoch is e is freed once the global epoch has reached e + 2, at which
+/// point every thread that could have seen the object has left the
+/// critical section it saw it in. The global epoch is advanced lazily, by
+/// retiring threads, once every thread inside a critical section has
+/// observed the current epoch.
+///
+/// Compared to hazard_pointer_domain a reader pays one fence per operation
+/// rather than one per protected pointer, but a thread that stalls inside a
+/// critical section holds up reclamation for everyone.
+class epoch_domain
+{
+public:
+
+    /// advance_threshold is the number of objects a thread retires between
+    /// attempts to advance the global epoch
+    explicit epoch_domain(std::size_t advance_threshold=64);
+
+    /// Frees every object still awaiting reclamation. No thread may be
+    /// using the domain concurrently.
+    ~epoch_domain();
+
+    /// \returns the domain used when none is specified
+    static epoch_domain& global();
+
+    /// \brief Enters a critical section. Critical sections nest.
+    void enter();
+
+    /// \brief Leaves the critical section most recently entered
+    void exit();
+
+    /// \brief Hands ptr to the domain to be deleted once no thread can hold
+    /// a reference to it. ptr must already be unreachable by other threads.
+    template <typename T>
+    void retire(T* ptr);
+
+    /// \brief Hands ptr to the domain to be freed with deleter once no
+    /// thread can hold a reference to it. ptr must already be unreachable by
+    /// other threads.
+    void retire(void* ptr, void (*deleter)(void*));
+
+    /// \brief Tries to advance the global epoch and frees whatever objects
+    /// retired by the calling thread have become safe to free
+    void reclaim();
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(epoch_domain);
+    friend class epoch_guard;
+
+    void enter(detail::epoch_record& record);
+    void exit(detail::epoch_record& record);
+    bool try_advance(uint64_t epoch);
+    void collect(detail::epoch_record& record, uint64_t epoch);
+
+    detail::thread_registry<detail::epoch_record> m_records;
+    std::size_t m_advance_threshold;
+    cache_padded<uint64_t> m_epoch;
+};
+
+
+/// \brief Holds the calling thread inside a critical section of an
+/// epoch_domain for its lifetime
+class epoch_guard
+{
+public:
+    explicit epoch_guard(epoch_domain& domain=epoch_domain::global()) :
+        m_domain(domain), m_record(domain.m_records.local())
+    {
+        m_domain.enter(m_record);
+    }
+
+    ~epoch_guard()
+    {
+        m_domain.exit(m_record);
+    }
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(epoch_guard);
+
+    epoch_domain& m_domain;
+    detail::epoch_record& m_record;
+};
+
+
+inline
+epoch_domain::epoch_domain(std::size_t advance_threshold) :
+    m_advance_threshold(advance_threshold), m_epoch(uint64_t(1))
+{
+}
+
+
+inline
+epoch_domain::~epoch_domain()
+{
+}
+
+
+inline epoch_domain&
+epoch_domain::global()
+{
+    static epoch_domain domain;
+    return domain;
+}
+
+
+inline void
+epoch_domain::enter()
+{
+    enter(m_records.local());
+}
+
+
+inline void
+epoch_domain::exit()
+{
+    exit(m_records.local());
+}
+
+
+inline void
+epoch_domain::enter(detail::epoch_record& record)
+{
+    if(0 == record.nesting++)
+    {
+        uint64_t epoch(MPM_LOAD(&*m_epoch, memory_order_relaxed));
+        MPM_STORE(&record.announcement, (epoch << 1) | 1u,
+                memory_order_relaxed);
+        // the announcement must be visible before any shared pointer is
+        // read; pairs with the fence in try_advance()
+        MPM_FENCE(memory_order_seq_cst);
+    }
+}
+
+
+inline void
+epoch_domain::exit(detail::epoch_record& record)
+{
+    assert(record.nesting > 0);
+    if(0 == --record.nesting)
+    {
+        // release so that our reads of shared objects happen before any
+        // thread sees us leave and frees them
+        MPM_STORE(&record.announcement, uint64_t(0), memory_order_release);
+    }
+}
+
+
+template <typename T>
+void
+epoch_domain::retire(T* ptr)
+{
+    retire(ptr, &detail::delete_object<T>);
+}
+
+
+inline void
+epoch_domain::retire(void* ptr, void (*deleter)(void*))
+{
+    detail::epoch_record& record(m_records.local());
+    uint64_t epoch(MPM_LOAD(&*m_epoch, memory_order_acquire));
+    collect(record, epoch);
+
+    std::size_t generation(epoch % detail::epoch_record::generations);
+    record.limbo_epoch[generation] = epoch;
+    detail::retired_ptr retired = { ptr, deleter };
+    record.limbo[generation].push_back(retired);
+
+    if(++record.retired_count >= m_advance_threshold)
+    {
+        record.retired_count = 0;
+        if(try_advance(epoch))
+            collect(record, epoch + 1);
+    }
+}
+
+
+inline void
+epoch_domain::reclaim()
+{
+    detail::epoch_record& record(m_records.local());
+    uint64_t epoch(MPM_LOAD(&*m_epoch, memory_order_acquire));
+    if(try_advance(epoch))
+        epoch++;
+    collect(record, epoch);
+}
+
+
+inline bool
+epoch_domain::try_advance(uint64_t epoch)
+{
+    // pairs with the fence in enter(); either we see a thread's
+    // announcement or it sees the object removed from the datastructure
+    MPM_FENCE(memory_order_seq_cst);
+    for(detail::epoch_record* r = m_records.first(); r; r = r->next)
+    {
+        uint64_t announcement(
+                MPM_LOAD(&r->announcement, memory_order_acquire));
+        if((announcement & 1u) && (announcement >> 1) != epoch)
+            return false;
+    }
+    return MPM_CAS_EXPLICIT(&*m_epoch, epoch, epoch + 1, memory_order_acq_rel);
+}
+
+
+inline void
+epoch_domain::collect(detail::epoch_record& record, uint64_t epoch)
+{
+    for(std::size_t i = 0; i < detail::epoch_record::generations; i++)
+    {
+        if(!record.limbo[i].empty() && record.limbo_epoch[i] + 2 <= epoch)
+            record.free_limbo(i);
+    }
+}
+
+
+/// \brief Reclamation policy for intrusive_lockfree_stack that keeps each
+/// pop inside a critical section of the global epoch_domain
+///
+/// Popped entries may then be freed with epoch_domain::global().retire(entry).
+struct epoch_reclamation
+{
+    class guard
+    {
+    public:
+        template <typename T, typename Tag>
+        T* protect(T* observed, Tag&, const atomic_tagged_ptr<T, Tag>&)
+        {
+            return observed;
+        }
+
+    private:
+        epoch_guard m_guard;
+    };
+};
+
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/deadline.hpp"
+#include "mpm/futex.hpp"
+#include "mpm/util.hpp"
+#include <climits>
+#include <stdint.h>
+
+namespace mpm {
+
+/// \brief Lets threads sleep until a condition on a lock-free datastructure
+/// may have become true
+///
+/// A waiter calls prepare_wait(), rechecks its condition and then either
+/// calls cancel_wait() if the condition now holds or commit_wait() with the
+/// key prepare_wait() returned, after which it rechecks again. A notifier
+/// makes the condition true and then calls notify_one() or notify_all().
+/// A notification that lands between prepare_wait() and commit_wait()
+/// makes commit_wait() return at once, so no wakeup is ever lost.
+///
+/// The waiter count is checked before anything else, so notifying while
+/// nobody waits costs a fence and a load that hits in the cache.
+class eventcount
+{
+public:
+    typedef uint32_t key_type;
+
+    eventcount() {}
+
+    /// \brief Announces that the calling thread is about to wait
+    /// \returns the key to pass to commit_wait()
+    key_type prepare_wait();
+
+    /// \brief Sleeps until notified, unless a notification has already
+    /// arrived since the prepare_wait() that returned key. May return
+    /// spuriously.
+    void commit_wait(key_type key);
+
+    /// \brief Like commit_wait(key) but sleeps for at most timeout_ns
+    /// nanoseconds
+    void commit_wait(key_type key, uint64_t timeout_ns);
+
+    /// \brief Withdraws the announcement made by prepare_wait()
+    void cancel_wait();
+
+    /// \brief Wakes one waiting thread, if there is one
+    void notify_one();
+
+    /// \brief Wakes every waiting thread
+    void notify_all();
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(eventcount);
+
+    // waiters counts the threads between prepare_wait() and the end of
+    // their wait; they sleep on epoch, which notifications bump
+    struct state
+    {
+        state() : waiters(0), epoch(0) {}
+        uint32_t waiters;
+        uint32_t epoch;
+    };
+
+    void notify(int count);
+
+    cache_padded<state> m_state;
+};
+
+
+inline eventcount::key_type
+eventcount::prepare_wait()
+{
+    MPM_FETCH_ADD(&m_state->waiters, 1u, memory_order_seq_cst);
+    // pairs with the fence in notify(): either the notifier sees us
+    // waiting or our recheck sees the condition it made true
+    MPM_FENCE(memory_order_seq_cst);
+    // acquire keeps the caller's recheck from happening before the epoch is
+    // read, which would let a notification slip in between
+    return MPM_LOAD(&m_state->epoch, memory_order_acquire);
+}
+
+
+inline void
+eventcount::commit_wait(key_type key)
+{
+    detail::futex_wait(&m_state->epoch, key);
+    cancel_wait();
+}
+
+
+inline void
+eventcount::commit_wait(key_type key, uint64_t timeout_ns)
+{
+    detail::futex_wait(&m_state->epoch, key, &timeout_ns);
+    cancel_wait();
+}
+
+
+inline void
+eventcount::cancel_wait()
+{
+    MPM_FETCH_ADD(&m_state->waiters, uint32_t(-1), memory_order_relaxed);
+}
+
+
+inline void
+eventcount::notify_one()
+{
+    notify(1);
+}
+
+
+inline void
+eventcount::notify_all()
+{
+    notify(INT_MAX);
+}
+
+
+inline void
+eventcount::notify(int count)
+{
+    // orders the caller's update of the condition before the load of the
+    // waiter count; pairs with the fence in prepare_wait()
+    MPM_FENCE(memory_order_seq_cst);
+    if(0 == MPM_LOAD(&m_state->waiters, memory_order_relaxed))
+        return;
+    MPM_FETCH_ADD(&m_state->epoch, 1u, memory_order_release);
+    detail::futex_wake(&m_state->epoch, count);
+}
+
+
+/// \brief Wraps a lock-free container with an eventcount so that pops can
+/// wait for a push
+///
+/// Container must have push(reference) and a non-blocking pop() that
+/// returns NULL when there is nothing to pop, as intrusive_lockfree_stack
+/// and intrusive_lockfree_mpsc_queue do. Pushes made through the adapter
+/// notify one waiter; pop() is the container's own and costs nothing extra.
+/// Pop from an intrusive_lockfree_mpsc_queue only on its one consumer
+/// thread, as usual.
+///
+/// An intrusive_lockfree_stack with futex_parking has pop_wait() of its own,
+/// which is cheaper on the push side; the adapter is for containers that do
+/// not.
+template <typename Container>
+class blocking_adapter
+{
+public:
+    typedef Container                           container_type;
+    typedef typename Container::value_type      value_type;
+    typedef typename Container::pointer         pointer;
+    typedef typename Container::reference       reference;
+
+    blocking_adapter() {}
+
+    /// \brief Pushes value into the container and wakes a waiting popper
+    void push(reference value);
+
+    /// \brief Pops from the container without blocking
+    pointer pop();
+
+    /// \brief Pops from the container, sleeping until something is pushed
+    /// if it is empty
+    pointer pop_wait();
+
+    /// \brief Like pop_wait() but gives up once timeout_ns nanoseconds have
+    /// passed
+    ///
+    /// \returns NULL if nothing could be popped within the timeout
+    pointer pop_wait_for(uint64_t timeout_ns);
+
+    /// \returns the wrapped container. Values pushed into it directly do
+    /// not wake waiters.
+    container_type& container();
+
+    /// \returns the eventcount waiters sleep on, for notifying them of
+    /// values pushed into the container directly
+    eventcount& events();
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(blocking_adapter);
+
+    // the number of times pop_wait retries pop() before going to sleep
+    enum { WAIT_SPINS = 64 };
+
+    pointer wait(const uint64_t* timeout_ns);
+
+    Container m_container;
+    eventcount m_events;
+};
+
+
+template <typename C>
+void
+blocking_adapter<C>::push(reference value)
+{
+    m_container.push(value);
+    m_events.notify_one();
+}
+
+
+template <typename C>
+typename blocking_adapter<C>::pointer
+blocking_adapter<C>::pop()
+{
+    return m_container.pop();
+}
+
+
+template <typename C>
+typename blocking_adapter<C>::pointer
+blocking_adapter<C>::pop_wait()
+{
+    return wait(NULL);
+}
+
+
+template <typename C>
+typename blocking_adapter<C>::pointer
+blocking_adapter<C>::pop_wait_for(uint64_t timeout_ns)
+{
+    return wait(&timeout_ns);
+}
+
+
+template <typename C>
+typename blocking_adapter<C>::container_type&
+blocking_adapter<C>::container()
+{
+    return m_container;
+}
+
+
+template <typename C>
+eventcount&
+blocking_adapter<C>::events()
+{
+    return m_events;
+}
+
+
+template <typename C>
+typename blocking_adapter<C>::pointer
+blocking_adapter<C>::wait(const uint64_t* timeout_ns)
+{
+    for(unsigned int i = 0; i < WAIT_SPINS; i++)
+    {
+        pointer value(m_container.pop());
+        if(value)
+            return value;
+        MPM_CPU_RELAX();
+    }
+
+    const uint64_t start(timeout_ns ? detail::monotonic_ns() : 0);
+    while(true)
+    {
+        eventcount::key_type key(m_events.prepare_wait());
+        pointer value(m_container.pop());
+        if(value)
+        {
+            m_events.cancel_wait();
+            return value;
+        }
+        if(!timeout_ns)
+        {
+            m_events.commit_wait(key);
+            continue;
+        }
+        uint64_t elapsed(detail::monotonic_ns() - start);
+        if(elapsed >= *timeout_ns)
+        {
+            m_events.cancel_wait();
+            return NULL;
+        }
+        m_events.commit_wait(key, *timeout_ns - elapsed);
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <climits>
+#include <stdint.h>
+#include <time.h>
+#if defined(__linux__)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#else
+    #include <sched.h>
+#endif
+
+namespace mpm {
+
+/// \file
+/// Thin wrappers around the Linux futex system call for parking threads on
+/// a 32 bit word.
+///
+/// Other platforms fall back to sleeping for a short while (or yielding)
+/// and rechecking, which keeps waiters correct but slow to wake.
+
+namespace detail {
+
+    /// Sleeps while *word == expected, until woken by futex_wake or for
+    /// at most timeout_ns nanoseconds. May return spuriously; callers must
+    /// recheck their condition.
+    inline void futex_wait(const uint32_t* word, uint32_t expected,
+            const uint64_t* timeout_ns=0)
+    {
+#if defined(__linux__)
+        timespec ts;
+        timespec* tsp(0);
+        if(timeout_ns)
+        {
+            ts.tv_sec = *timeout_ns / 1000000000u;
+            ts.tv_nsec = *timeout_ns % 1000000000u;
+            tsp = &ts;
+        }
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, tsp, 0, 0);
+#else
+        (void)expected;
+        if(timeout_ns && *timeout_ns < 50000u)
+        {
+            sched_yield();
+            return;
+        }
+        timespec ts = { 0, 50000 };
+        nanosleep(&ts, 0);
+#endif
+    }
+
+
+    /// Wakes up to count threads sleeping in futex_wait on word
+    inline void futex_wake(uint32_t* word, int count=INT_MAX)
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, 0, 0, 0);
+#else
+        (void)word;
+        (void)count;
+#endif
+    }
+}
+
+}
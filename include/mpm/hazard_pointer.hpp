@@ -0,0 +1,303 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/atomic_tagged_ptr.hpp"
+#include "mpm/reclamation.hpp"
+#include "mpm/util.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace mpm {
+
+namespace detail {
+
+    /// Per-thread state within a hazard_pointer_domain. Objects still
+    /// waiting to be reclaimed when a thread exits stay with its record and
+    /// are inherited by the next thread to adopt it.
+    struct hazard_record
+    {
+        enum { slots = 4 };
+
+        hazard_record() : active(true), used_slots(0), next(0)
+        {
+            for(std::size_t i = 0; i < slots; i++)
+                hazards[i] = 0;
+        }
+
+        ~hazard_record()
+        {
+            for(std::size_t i = 0; i < retired.size(); i++)
+                retired[i].deleter(retired[i].ptr);
+        }
+
+        void on_thread_exit()
+        {
+            for(std::size_t i = 0; i < slots; i++)
+                MPM_STORE(&hazards[i], static_cast<void*>(0),
+                        memory_order_relaxed);
+            used_slots = 0;
+        }
+
+        void* hazards[slots];
+        bool active;
+
+        // only ever touched by the owning thread
+        unsigned int used_slots;
+        std::vector<retired_ptr> retired;
+
+        hazard_record* next;
+    };
+}
+
+
+/// \brief A set of hazard pointers and the objects they protect
+///
+/// Hazard pointers (Michael, 2004) let a thread announce that it is about to
+/// dereference a shared object so that other threads which have removed
+/// that object from a datastructure defer freeing it. Each thread gets
+/// detail::hazard_record::slots hazard pointers per domain.
+///
+/// Retired objects are collected in a per-thread list and only scanned
+/// against the published hazard pointers once that list reaches the scan
+/// threshold (or twice the number of hazard pointers in the domain,
+/// whichever is larger) so the cost of a scan is amortized over many
+/// retires and is never paid on the read side.
+class hazard_pointer_domain
+{
+public:
+
+    explicit hazard_pointer_domain(std::size_t scan_threshold=64);
+
+    /// Frees every object still awaiting reclamation. No thread may be
+    /// using the domain concurrently.
+    ~hazard_pointer_domain();
+
+    /// \returns the domain used when none is specified
+    static hazard_pointer_domain& global();
+
+    /// \brief Hands ptr to the domain to be deleted once no hazard pointer
+    /// refers to it. ptr must already be unreachable by other threads.
+    template <typename T>
+    void retire(T* ptr);
+
+    /// \brief Hands ptr to the domain to be freed with deleter once no
+    /// hazard pointer refers to it. ptr must already be unreachable by other
+    /// threads.
+    void retire(void* ptr, void (*deleter)(void*));
+
+    /// \brief Frees every object retired by the calling thread that is not
+    /// currently protected by a hazard pointer
+    void reclaim();
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(hazard_pointer_domain);
+    friend class hazard_pointer;
+
+    void scan(detail::hazard_record& record);
+
+    detail::thread_registry<detail::hazard_record> m_records;
+    std::size_t m_scan_threshold;
+};
+
+
+/// \brief Owns one of the calling thread's hazard pointers for its lifetime
+///
+/// A hazard_pointer must be used only by the thread that created it.
+class hazard_pointer
+{
+public:
+
+    explicit hazard_pointer(
+            hazard_pointer_domain& domain=hazard_pointer_domain::global());
+    ~hazard_pointer();
+
+    /// \brief Publishes ptr as in use. ptr is protected only once the caller
+    /// has subsequently confirmed that it is still reachable from where it
+    /// was loaded; prefer protect().
+    void set(const void* ptr);
+
+    /// \brief Withdraws protection from the currently published pointer
+    void clear();
+
+    /// \brief Protects the pointer held in src
+    ///
+    /// observed (and tag) must be values previously read from src. They are
+    /// published and revalidated against src until stable.
+    ///
+    /// \returns the protected pointer, which may be NULL; tag receives its
+    ///          tag.
+    template <typename T, typename Tag>
+    T* protect(T* observed, Tag& tag, const atomic_tagged_ptr<T, Tag>& src);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(hazard_pointer);
+
+    detail::hazard_record* m_record;
+    unsigned int m_index;
+};
+
+
+inline
+hazard_pointer_domain::hazard_pointer_domain(std::size_t scan_threshold) :
+    m_scan_threshold(scan_threshold)
+{
+}
+
+
+inline
+hazard_pointer_domain::~hazard_pointer_domain()
+{
+}
+
+
+inline hazard_pointer_domain&
+hazard_pointer_domain::global()
+{
+    static hazard_pointer_domain domain;
+    return domain;
+}
+
+
+template <typename T>
+void
+hazard_pointer_domain::retire(T* ptr)
+{
+    retire(ptr, &detail::delete_object<T>);
+}
+
+
+inline void
+hazard_pointer_domain::retire(void* ptr, void (*deleter)(void*))
+{
+    detail::hazard_record& record(m_records.local());
+    detail::retired_ptr retired = { ptr, deleter };
+    record.retired.push_back(retired);
+
+    std::size_t hazard_count(
+            detail::hazard_record::slots * m_records.size());
+    if(record.retired.size() >= std::max(m_scan_threshold, 2 * hazard_count))
+        scan(record);
+}
+
+
+inline void
+hazard_pointer_domain::reclaim()
+{
+    scan(m_records.local());
+}
+
+
+inline void
+hazard_pointer_domain::scan(detail::hazard_record& record)
+{
+    // pairs with the fence in hazard_pointer::set(); either we see the
+    // hazard or the protecting thread sees that the object was removed
+    MPM_FENCE(memory_order_seq_cst);
+
+    std::vector<void*> hazards;
+    for(detail::hazard_record* r = m_records.first(); r; r = r->next)
+    {
+        for(std::size_t i = 0; i < detail::hazard_record::slots; i++)
+        {
+            void* hazard(MPM_LOAD(&r->hazards[i], memory_order_acquire));
+            if(hazard)
+                hazards.push_back(hazard);
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+
+    std::vector<detail::retired_ptr> still_hazardous;
+    for(std::size_t i = 0; i < record.retired.size(); i++)
+    {
+        if(std::binary_search(
+                    hazards.begin(), hazards.end(), record.retired[i].ptr))
+            still_hazardous.push_back(record.retired[i]);
+        else
+            record.retired[i].deleter(record.retired[i].ptr);
+    }
+    record.retired.swap(still_hazardous);
+}
+
+
+inline
+hazard_pointer::hazard_pointer(hazard_pointer_domain& domain) :
+    m_record(&domain.m_records.local()), m_index(0)
+{
+    while(m_record->used_slots & (1u << m_index))
+        m_index++;
+    // a thread holds more hazard pointers than the domain provides
+    assert(m_index < detail::hazard_record::slots);
+    m_record->used_slots |= 1u << m_index;
+}
+
+
+inline
+hazard_pointer::~hazard_pointer()
+{
+    clear();
+    m_record->used_slots &= ~(1u << m_index);
+}
+
+
+inline void
+hazard_pointer::set(const void* ptr)
+{
+    MPM_STORE(&m_record->hazards[m_index], const_cast<void*>(ptr),
+            memory_order_relaxed);
+    // the hazard must be visible before the caller revalidates ptr
+    MPM_FENCE(memory_order_seq_cst);
+}
+
+
+inline void
+hazard_pointer::clear()
+{
+    // release so that our reads of the object happen before it is freed
+    MPM_STORE(&m_record->hazards[m_index], static_cast<void*>(0),
+            memory_order_release);
+}
+
+
+template <typename T, typename Tag>
+T*
+hazard_pointer::protect(
+        T* observed, Tag& tag, const atomic_tagged_ptr<T, Tag>& src)
+{
+    while(true)
+    {
+        set(observed);
+        Tag current_tag;
+        T* current(src.get(current_tag, memory_order_acquire));
+        tag = current_tag;
+        if(current == observed)
+            return observed;
+        observed = current;
+    }
+}
+
+
+/// \brief Reclamation policy for intrusive_lockfree_stack that protects
+/// the top of the stack with a hazard pointer from the global domain while
+/// it is being popped
+///
+/// Popped entries may then be freed with
+/// hazard_pointer_domain::global().retire(entry).
+struct hazard_pointer_reclamation
+{
+    class guard
+    {
+    public:
+        template <typename T, typename Tag>
+        T* protect(T* observed, Tag& tag, const atomic_tagged_ptr<T, Tag>& src)
+        {
+            return m_hazard.protect(observed, tag, src);
+        }
+
+    private:
+        hazard_pointer m_hazard;
+    };
+};
+
+}
@@ -6,10 +6,64 @@
 #pragma once
 
 #include "mpm/atomic.hpp"
+#include "mpm/backoff.hpp"
 #include "mpm/util.hpp"
+#include "mpm/wait_strategy.hpp"
+#include <cstddef>
 
 namespace mpm {
 
+/// Keeps the stub node, the producer-side head and the consumer-side tail
+/// packed together. Smallest footprint but every producer exchange on the
+/// head invalidates the line holding the consumer's tail.
+struct mpsc_compact_layout {};
+
+/// Gives the stub node, the head and the tail a cache line each so that
+/// producers and the consumer only share the lines they must.
+struct mpsc_padded_layout {};
+
+
+namespace detail {
+
+    template <typename T, typename Layout>
+    class mpsc_queue_storage;
+
+
+    template <typename T>
+    class mpsc_queue_storage<T, mpsc_compact_layout>
+    {
+    public:
+        mpsc_queue_storage() : m_head(&m_stub), m_tail(&m_stub) {}
+
+        T& stub() { return m_stub; }
+        T*& head() { return m_head; }
+        T*& tail() { return m_tail; }
+
+    private:
+        T m_stub;
+        T* m_head;
+        T* m_tail;
+    };
+
+
+    template <typename T>
+    class mpsc_queue_storage<T, mpsc_padded_layout>
+    {
+    public:
+        mpsc_queue_storage() : m_head(&*m_stub), m_tail(&*m_stub) {}
+
+        T& stub() { return *m_stub; }
+        T*& head() { return *m_head; }
+        T*& tail() { return *m_tail; }
+
+    private:
+        cache_padded<T> m_stub;
+        cache_padded<T*> m_head;
+        cache_padded<T*> m_tail;
+    };
+}
+
+
 /// \brief An intrusive lock-free MPSC queue
 ///
 /// Values are NEVER copied into this datastructure, their lifetimes must
@@ -19,95 +73,319 @@ namespace mpm {
 ///      mpm_intrusive_lockfree_mpsc_queue_set_next(T volatile&, T*):void exist
 ///      in the same namespace as T, or
 ///  (2) T publicly extends mpm::intrusive_lockfree_mpsc_queue_entry<T>
-template <typename T>
+///
+/// Layout selects how the queue's own state is laid out in memory; see
+/// mpsc_padded_layout and mpsc_compact_layout.
+///
+/// Wait selects how pop_wait() waits for a value; see wait_strategy.hpp.
+///
+/// Producers never dereference an entry already in the queue other than the
+/// one they are linking to, and only the consumer reads entries through the
+/// queue, so an entry may be freed as soon as it has been popped; no
+/// reclamation policy is needed here.
+template <typename T, typename Layout=mpsc_padded_layout,
+         typename Wait=pause_wait>
 class intrusive_lockfree_mpsc_queue
 {
 public:
 
     typedef T value_type;
     typedef T* pointer;
-    typedef T* volatile volatile_pointer;
     typedef T& reference;
+    typedef Layout layout_type;
+    typedef Wait wait_strategy;
 
     intrusive_lockfree_mpsc_queue();
 
     void push(reference value);
+
+    /// \brief Pushes a chain of values onto the back of the queue with a
+    /// single exchange
+    /// The values from first to last must already be linked to one another
+    /// with mpm_intrusive_lockfree_mpsc_queue_set_next; the next pointer of
+    /// last is overwritten. The values are popped in chain order, with
+    /// first leaving the queue first.
+    ///
+    /// param[in] first the value to put at the front of the chain
+    /// param[in] last the value to put at the back of the queue
+    void push_chain(reference first, reference last);
+
+    /// \brief Pops the value at the front of the queue. Does not block.
+    ///
+    /// \returns NULL if *this is empty or if a producer has claimed the
+    ///          next position in the queue but not yet linked its value in,
+    ///          otherwise the value removed from the front of the queue.
     pointer pop();
 
+    /// \brief Pops the value at the front of the queue, retrying while a
+    /// producer is part way through a push.
+    ///
+    /// backoff() is invoked between attempts; see backoff.hpp.
+    ///
+    /// \returns NULL only if *this was empty, otherwise the value removed
+    ///          from the front of the queue.
+    template <typename Backoff>
+    pointer pop(Backoff backoff);
+
+    /// \brief Pops up to max values from the front of the queue in one pass.
+    /// Does not block.
+    ///
+    /// Walks the queue as far as producers have linked it, so like pop() it
+    /// stops short at a producer that is part way through a push. The head
+    /// of the queue is read at most once per call rather than once per value.
+    ///
+    /// \returns the number of values written to out, in FIFO order
+    template <typename OutputIterator>
+    std::size_t pop_bulk(OutputIterator out, std::size_t max);
+
+    /// \brief Pops every value producers have finished pushing and passes
+    /// each to f in FIFO order. Does not block.
+    ///
+    /// The next value is prefetched while f runs. f may do what it likes
+    /// with the value it is given, but must not pop from this queue, and
+    /// values it pushes onto this queue may be passed to it again in the
+    /// same call.
+    ///
+    /// \returns the number of values passed to f
+    template <typename F>
+    std::size_t consume_all(F f);
+
+    /// \brief Pops the value at the front of the queue, waiting for one to
+    /// be pushed if the queue is empty
+    ///
+    /// How the consumer waits is up to Wait.
+    ///
+    /// \returns the value removed from the front of the queue
+    pointer pop_wait();
+
 private:
     MPM_DISALLOW_COPY_AND_ASSIGN(intrusive_lockfree_mpsc_queue);
 
-    value_type m_stub;
-    volatile_pointer m_head;
-    pointer m_tail;
+    void link(reference first, reference last);
+    pointer get_next(const T& entry) const;
+
+    template <typename Sink>
+    std::size_t drain(Sink& sink, std::size_t max);
+
+    detail::mpsc_queue_storage<T, Layout> m_storage;
+    Wait m_wait;
 };
 
 
-template <typename T>
-intrusive_lockfree_mpsc_queue<T>::intrusive_lockfree_mpsc_queue() :
-    m_head(&m_stub), m_tail(&m_stub)
+template <typename T, typename L, typename W>
+intrusive_lockfree_mpsc_queue<T, L, W>::intrusive_lockfree_mpsc_queue()
 {
-    mpm_intrusive_lockfree_mpsc_queue_set_next(m_stub, static_cast<pointer>(0));
+    mpm_intrusive_lockfree_mpsc_queue_set_next(
+            m_storage.stub(), static_cast<pointer>(0));
 }
 
 
-template <typename T>
+template <typename T, typename L, typename W>
 void
-intrusive_lockfree_mpsc_queue<T>::push(reference value)
+intrusive_lockfree_mpsc_queue<T, L, W>::push(reference value)
 {
-    mpm_intrusive_lockfree_mpsc_queue_set_next(value, static_cast<pointer>(0));
-    pointer prev(MPM_EXCHG(&m_head, &value));
-    mpm_intrusive_lockfree_mpsc_queue_set_next(*prev, &value);
+    link(value, value);
+    m_wait.notify();
 }
 
 
-template <typename T>
-typename intrusive_lockfree_mpsc_queue<T>::pointer
-intrusive_lockfree_mpsc_queue<T>::pop()
+template <typename T, typename L, typename W>
+void
+intrusive_lockfree_mpsc_queue<T, L, W>::push_chain(
+        reference first, reference last)
+{
+    link(first, last);
+    m_wait.notify();
+}
+
+
+template <typename T, typename L, typename W>
+void
+intrusive_lockfree_mpsc_queue<T, L, W>::link(reference first, reference last)
 {
-    pointer tail = m_tail;
-    pointer next(
-        mpm_intrusive_lockfree_mpsc_queue_get_next(*tail));
+    mpm_intrusive_lockfree_mpsc_queue_set_next(last, static_cast<pointer>(0));
+    // acq_rel: release our null next pointer to the producer that will link
+    // after us and acquire the previous producer's null before we overwrite it
+    pointer prev(MPM_EXCHG_EXPLICIT(
+                &m_storage.head(), &last, memory_order_acq_rel));
+    // publish the contents of the chain, and the links within it, to the
+    // consumer before linking it in
+    MPM_FENCE(memory_order_release);
+    mpm_intrusive_lockfree_mpsc_queue_set_next(*prev, &first);
+}
+
 
-    if (tail == &m_stub)
+template <typename T, typename L, typename W>
+typename intrusive_lockfree_mpsc_queue<T, L, W>::pointer
+intrusive_lockfree_mpsc_queue<T, L, W>::get_next(const T& entry) const
+{
+    pointer next(mpm_intrusive_lockfree_mpsc_queue_get_next(entry));
+    // pairs with the release fence in push()
+    MPM_FENCE(memory_order_acquire);
+    return next;
+}
+
+
+template <typename T, typename L, typename W>
+typename intrusive_lockfree_mpsc_queue<T, L, W>::pointer
+intrusive_lockfree_mpsc_queue<T, L, W>::pop()
+{
+    pointer tail = m_storage.tail();
+    pointer next(get_next(*tail));
+
+    if (tail == &m_storage.stub())
     {
         if (0 == next)
             return 0;
-        m_tail = next;
+        m_storage.tail() = next;
         tail = next;
-        next = mpm_intrusive_lockfree_mpsc_queue_get_next(*next);
+        next = get_next(*next);
     }
     if (next)
     {
-        m_tail = next;
+        m_storage.tail() = next;
         return tail;
     }
-    T* head = m_head;
+    // only compared against tail; nothing is read through it
+    T* head = MPM_LOAD(&m_storage.head(), memory_order_relaxed);
     if (tail != head)
         return 0;
-    push(m_stub);
-    next = mpm_intrusive_lockfree_mpsc_queue_get_next(*tail);
+    // not push(): the consumer has nobody to notify but itself
+    link(m_storage.stub(), m_storage.stub());
+    next = get_next(*tail);
     if (next)
     {
-        m_tail = next;
+        m_storage.tail() = next;
         return tail;
     }
     return 0;
 }
 
 
+template <typename T, typename L, typename W>
+template <typename Backoff>
+typename intrusive_lockfree_mpsc_queue<T, L, W>::pointer
+intrusive_lockfree_mpsc_queue<T, L, W>::pop(Backoff backoff)
+{
+    while(true)
+    {
+        pointer popped(pop());
+        if(popped)
+            return popped;
+        // with the stub at both ends nothing can be in flight
+        pointer stub(&m_storage.stub());
+        if(m_storage.tail() == stub &&
+                MPM_LOAD(&m_storage.head(), memory_order_relaxed) == stub)
+            return 0;
+        backoff();
+    }
+}
+
+
+template <typename T, typename L, typename W>
+typename intrusive_lockfree_mpsc_queue<T, L, W>::pointer
+intrusive_lockfree_mpsc_queue<T, L, W>::pop_wait()
+{
+    return m_wait.pop_wait(*this);
+}
+
+
+namespace detail {
+
+    template <typename OutputIterator>
+    class mpsc_output_sink
+    {
+    public:
+        explicit mpsc_output_sink(OutputIterator out) : m_out(out) {}
+
+        template <typename T>
+        void operator()(T* value) { *m_out++ = value; }
+
+    private:
+        OutputIterator m_out;
+    };
+}
+
+
+template <typename T, typename L, typename W>
+template <typename OutputIterator>
+std::size_t
+intrusive_lockfree_mpsc_queue<T, L, W>::pop_bulk(
+        OutputIterator out, std::size_t max)
+{
+    detail::mpsc_output_sink<OutputIterator> sink(out);
+    return drain(sink, max);
+}
+
+
+template <typename T, typename L, typename W>
+template <typename F>
+std::size_t
+intrusive_lockfree_mpsc_queue<T, L, W>::consume_all(F f)
+{
+    return drain(f, std::size_t(-1));
+}
+
+
+template <typename T, typename L, typename W>
+template <typename Sink>
+std::size_t
+intrusive_lockfree_mpsc_queue<T, L, W>::drain(Sink& sink, std::size_t max)
+{
+    // the same steps as pop(), but the tail is kept in a register and only
+    // written back once at the end
+    const pointer stub(&m_storage.stub());
+    pointer tail(m_storage.tail());
+    std::size_t count(0);
+    bool head_checked(false);
+    while(count < max)
+    {
+        pointer next(get_next(*tail));
+        if(tail == stub)
+        {
+            if(0 == next)
+                break;
+            tail = next;
+            continue;
+        }
+        if(0 == next)
+        {
+            // tail is the last linked entry. Unless a producer is part way
+            // through a push after it, put the stub behind it so that it
+            // can be handed out.
+            if(head_checked)
+                break;
+            head_checked = true;
+            if(tail != MPM_LOAD(&m_storage.head(), memory_order_relaxed))
+                break;
+            link(*stub, *stub);
+            next = get_next(*tail);
+            if(0 == next)
+                break;
+        }
+        // next was read above, so tail is the caller's from here on
+        MPM_PREFETCH(next);
+        sink(tail);
+        count++;
+        tail = next;
+    }
+    m_storage.tail() = tail;
+    return count;
+}
+
+
 template <typename T>
 inline void mpm_intrusive_lockfree_mpsc_queue_set_next(
         T volatile& entry, T* next)
 {
-    entry.next = next;
+    MPM_STORE(&entry.next, next, memory_order_relaxed);
 }
 
 
 template <typename T>
 inline T* mpm_intrusive_lockfree_mpsc_queue_get_next(const T volatile& entry)
 {
-    return entry.next;
+    return MPM_LOAD(&entry.next, memory_order_relaxed);
 }
 
 
@@ -2,34 +2,278 @@
 
 #include "mpm/atomic.hpp"
 #include "mpm/atomic_tagged_ptr.hpp"
-#include "mpm/lockfree_exchanger.hpp"
+#include "mpm/backoff.hpp"
+#include "mpm/deadline.hpp"
+#include "mpm/elimination_slot.hpp"
+#include "mpm/parking.hpp"
+#include "mpm/reclamation.hpp"
+#include "mpm/stats.hpp"
 #include "mpm/util.hpp"
 #include <cassert>
+#include <climits>
 #include <cstddef>
+#include <iterator>
+#include <stdint.h>
 
 
 namespace mpm {
 
 
-template <std::size_t Slots, unsigned int Timeout, unsigned int Attempts>
+/// \brief Elimination range policy that always chooses among every slot
+///
+/// A range policy decides how many of the elimination slots (counting from
+/// the first) an elimination attempt chooses among. width(slots) returns
+/// that number, which must be a power of two no greater than slots, and
+/// record(slots, result) is told the outcome of every attempt.
+struct fixed_elimination_range
+{
+    static std::size_t width(std::size_t slots) { return slots; }
+    static void record(std::size_t, exchange_result) {}
+};
+
+
+/// \brief Elimination range policy that adapts to contention
+///
+/// Follows Hendler, Shavit and Yerushalmi: each thread keeps its own range,
+/// which is halved after Threshold more elimination attempts have timed out
+/// without a partner than have collided with other threads, and doubled
+/// after Threshold more collisions than timeouts, so a lightly loaded thread
+/// concentrates on the few slots where it is likely to meet a partner while
+/// a heavily loaded one spreads out over the whole array. A collision
+/// is a slot that stayed occupied for the whole timeout or one where the
+/// same operation was already waiting.
+///
+/// The range is kept in thread-local storage shared by every stack that
+/// uses the same elimination options.
+template <int Threshold=8>
+class adaptive_elimination_range
+{
+public:
+    static std::size_t width(std::size_t slots)
+    {
+        std::size_t width(slots >> s_shrink);
+        return width ? width : 1;
+    }
+
+    static void record(std::size_t slots, exchange_result result)
+    {
+        if(exchange_success == result)
+            return;
+        s_score += exchange_timeout == result ? -1 : 1;
+        if(s_score <= -Threshold)
+        {
+            if((slots >> s_shrink) > 1)
+                s_shrink++;
+            s_score = 0;
+        }
+        else if(s_score >= Threshold)
+        {
+            if(s_shrink > 0)
+                s_shrink--;
+            s_score = 0;
+        }
+    }
+
+private:
+    MPM_STATIC_ASSERT(Threshold > 0);
+
+    static __thread unsigned int s_shrink;
+    static __thread int s_score;
+};
+
+
+template <int Threshold>
+__thread unsigned int adaptive_elimination_range<Threshold>::s_shrink = 0;
+
+
+template <int Threshold>
+__thread int adaptive_elimination_range<Threshold>::s_score = 0;
+
+
+namespace detail {
+
+    /// \returns a non-zero value that differs between threads
+    inline uint32_t thread_seed()
+    {
+        static __thread char anchor;
+        // the murmur3 finalizer spreads the bits of the thread-local address,
+        // which differ between threads only above the alignment of the TLS
+        // block, into the low bits that slot selection uses
+        uintptr_t addr(reinterpret_cast<uintptr_t>(&anchor));
+        uint32_t h(static_cast<uint32_t>(addr ^ (uint64_t(addr) >> 32)));
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h ? h : 1u;
+    }
+}
+
+
+/// \brief Elimination slot selector that picks a slot at random
+///
+/// A slot selector provides select(width), which returns the index of the
+/// slot an elimination attempt should use out of the first width slots.
+/// width is always a power of two.
+///
+/// Each thread draws from its own xorshift generator, seeded from the
+/// address of its thread-local state, so threads that arrive together do
+/// not pick correlated slots.
+class random_slot_selector
+{
+public:
+    static std::size_t select(std::size_t width)
+    {
+        // function-local so that the header needs no out-of-line definition
+        static __thread uint32_t state;
+        uint32_t x(state ? state : detail::thread_seed());
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state = x;
+        return x & (width - 1);
+    }
+};
+
+
+/// \brief Elimination slot selector that gives each thread a fixed slot
+///
+/// Threads keep returning to the same slot (folded into the current width),
+/// which keeps a slot's cache line with the threads that use it and suits
+/// workloads where the same pairs of threads keep meeting.
+class sticky_slot_selector
+{
+public:
+    static std::size_t select(std::size_t width)
+    {
+        static __thread uint32_t slot;
+        if(0 == slot)
+            slot = detail::thread_seed();
+        return slot & (width - 1);
+    }
+};
+
+
+template <std::size_t Slots, unsigned int Timeout, unsigned int Attempts,
+         typename Range=fixed_elimination_range,
+         typename Selector=random_slot_selector,
+         typename Deadline=spin_deadline>
 struct elimination_opts
 {
     /// the number of elimination slots to use
     static const std::size_t slots = Slots;
 
-    /// how long to stay in each elimination attempt; expressed as a number of
-    /// times to spin in the elimination loop
+    /// whether elimination is compiled in at all
+    static const bool enabled = Slots != 0 && Attempts != 0;
+
+    /// how long to stay in each elimination attempt, in the units of
+    /// deadline_type: a number of times to spin in the elimination loop for
+    /// spin_deadline, nanoseconds for tsc_deadline
     static const unsigned int timeout = Timeout;
 
     /// The number of times to select and participate in an elimination slot
     /// before going back to the central datastructure
     static const unsigned int attempts = Attempts;
+
+    /// how many of the slots each attempt chooses among; see
+    /// fixed_elimination_range and adaptive_elimination_range
+    typedef Range range_policy;
+
+    /// which of those slots an attempt uses; see random_slot_selector and
+    /// sticky_slot_selector
+    typedef Selector slot_selector;
+
+    /// how the timeout is measured; see deadline.hpp
+    typedef Deadline deadline_type;
+
+    /// \brief The elimination parameters a stack reads at runtime
+    ///
+    /// Here they are the constants above; see runtime_elimination_opts for
+    /// parameters that can be changed while a stack is in use. A stack
+    /// reports the progress of each of its operations through an
+    /// operation, which here does nothing.
+    class params
+    {
+    public:
+        class operation
+        {
+        public:
+            explicit operation(params&) {}
+            void cas_failed() {}
+            void eliminated(exchange_result) {}
+        };
+
+        std::size_t slots() const { return Slots; }
+        unsigned int timeout() const { return Timeout; }
+        unsigned int attempts() const { return Attempts; }
+    };
 };
 
 
 typedef elimination_opts<0, 0, 0> disable_elimination;
 
 
+/// \brief A forward iterator over a chain of entries linked with
+/// mpm_lfs_get_next, such as the one returned by
+/// intrusive_lockfree_stack::pop_all()
+///
+/// The successor of the current entry is read when the iterator arrives at
+/// it, so the current entry may be pushed elsewhere, relinked or freed
+/// before the iterator is advanced. A default constructed iterator is the
+/// end of every chain.
+template <typename T>
+class lfs_chain_iterator
+{
+public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T                         value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef T*                        pointer;
+    typedef T&                        reference;
+
+    lfs_chain_iterator() : m_current(NULL), m_next(NULL) {}
+
+    explicit lfs_chain_iterator(pointer first) :
+        m_current(first), m_next(first ? mpm_lfs_get_next(*first) : NULL)
+    {
+    }
+
+    reference operator*() const { return *m_current; }
+    pointer operator->() const { return m_current; }
+
+    lfs_chain_iterator& operator++()
+    {
+        m_current = m_next;
+        if(m_current)
+            m_next = mpm_lfs_get_next(*m_current);
+        return *this;
+    }
+
+    lfs_chain_iterator operator++(int)
+    {
+        lfs_chain_iterator prev(*this);
+        ++*this;
+        return prev;
+    }
+
+    bool operator==(const lfs_chain_iterator& rhs) const
+    {
+        return m_current == rhs.m_current;
+    }
+
+    bool operator!=(const lfs_chain_iterator& rhs) const
+    {
+        return m_current != rhs.m_current;
+    }
+
+private:
+    pointer m_current;
+    pointer m_next;
+};
+
+
 /// \brief an intrusive lock-free stack
 ///
 /// The key feature of this implementation is that it uses an elimination array
@@ -44,8 +288,32 @@ typedef elimination_opts<0, 0, 0> disable_elimination;
 ///      mpm_lfs_set_next(T&, T*):void exist in the same namespace as T, or
 ///  (2) T extends mpm::intrusive_lockfree_stack_entry<T> (not necessary to extend
 ///      publicly)
-template <typename T, typename EliminationOpts=elimination_opts<16, 500, 2> >
-class intrusive_lockfree_stack
+///
+/// The top of the stack carries an ABA tag of type TopTag. The default 16 bit
+/// tag is packed alongside the pointer into a single word and wraps after
+/// 65536 operations; uint64_t selects a double-width CAS with a tag that
+/// will not wrap in practice (where the platform supports one).
+///
+/// Backoff is invoked each time an operation fails both on the central stack
+/// and in the elimination array, and is also used by the elimination slots
+/// while they wait for a partner; see backoff.hpp.
+///
+/// Reclaim makes it safe to free popped entries; see reclamation.hpp.
+///
+/// Stats decides which contention statistics are kept; see stats.hpp. The
+/// default keeps none and compiles away entirely.
+///
+/// Parking decides whether poppers can sleep on an empty stack with
+/// pop_wait() and pop_wait_for(); see parking.hpp. The default does not let
+/// them and costs pushes nothing.
+template <typename T, typename EliminationOpts=elimination_opts<16, 500, 2>,
+         typename TopTag=uint16_t, typename Backoff=no_backoff,
+         typename Reclaim=no_reclamation, typename Stats=no_stats,
+         typename Parking=no_parking>
+class intrusive_lockfree_stack :
+    // bases rather than members so that empty policies take no space
+    private Stats::template recorder<EliminationOpts::slots>,
+    private Parking
 {
 public:
 
@@ -53,6 +321,13 @@ public:
     typedef value_type&     reference;
     typedef value_type*     pointer;
     typedef EliminationOpts elimination_opts;
+    typedef TopTag          tag_type;
+    typedef Backoff         backoff_type;
+    typedef Reclaim         reclamation_type;
+    typedef Stats           stats_type;
+    typedef Parking         parking_type;
+    typedef lfs_chain_iterator<T> chain_iterator;
+    typedef typename elimination_opts::params elimination_params;
 
     intrusive_lockfree_stack();
 
@@ -64,6 +339,27 @@ public:
     /// param[in] value the value to put on the top of this stack
     void push(reference value);
 
+    /// \brief Pushes a chain of values onto the top of the stack with a
+    /// single CAS
+    /// The values from first to last must already be linked to one another
+    /// with mpm_lfs_set_next; the next pointer of last is overwritten. first
+    /// becomes the new top of the stack. The chain is only ever published
+    /// whole, so its values stay adjacent on the stack; unlike push(), a
+    /// chain of more than one value is never handed to a concurrent pop
+    /// through the elimination array and a failed CAS is simply retried.
+    ///
+    /// param[in] first the value to put on the top of this stack
+    /// param[in] last the value to link to the current top of this stack
+    void push_chain(reference first, reference last);
+
+    /// \brief Pushes the values in [begin, end) onto the stack with a single
+    /// CAS
+    /// The values are linked to one another in order, so *begin becomes the
+    /// new top of the stack. ForwardIterator must dereference to a
+    /// reference.
+    template <typename ForwardIterator>
+    void push_range(ForwardIterator begin, ForwardIterator end);
+
 
     /// \brief Pops a value from the top of the stack.
     /// Does not block.
@@ -72,6 +368,30 @@ public:
     ///          top of the stack.
     pointer pop();
 
+    /// \brief Pops a value from the top of the stack, waiting for one to be
+    /// pushed if the stack is empty
+    /// Only available with a Parking policy that supports it, such as
+    /// futex_parking, which retries pop() briefly and then sleeps on a futex
+    /// until a push wakes it.
+    ///
+    /// \returns the value removed from the top of the stack
+    pointer pop_wait();
+
+    /// \brief Like pop_wait() but gives up once timeout_ns nanoseconds have
+    /// passed
+    ///
+    /// \returns NULL if nothing could be popped within the timeout,
+    ///          otherwise the value removed from the top of the stack.
+    pointer pop_wait_for(uint64_t timeout_ns);
+
+    /// \brief Atomically detaches every value on the stack
+    /// Does not block. The values stay linked to one another in LIFO order
+    /// and can be walked with chain_iterator.
+    ///
+    /// \returns NULL if *this is empty, otherwise the value that was on the
+    ///          top of the stack.
+    pointer pop_all();
+
     /// \brief Clears this stack
     /// Does NOT free the memory associated with the entries in this stack
     void clear();
@@ -81,6 +401,14 @@ public:
     /// \returns true if the stack is empty, false otherwise
     bool empty() const;
 
+    /// \returns the parameters that govern elimination on this stack, which
+    ///          can be changed while it is in use when EliminationOpts is a
+    ///          runtime_elimination_opts
+    elimination_params& elimination_parameters();
+
+    /// \returns a snapshot of the contention statistics kept by Stats
+    stack_stats stats() const;
+
 private:
     MPM_DISALLOW_COPY_AND_ASSIGN(intrusive_lockfree_stack);
     MPM_STATIC_ASSERT(0 == (elimination_opts::slots &
@@ -88,52 +416,130 @@ private:
 
     enum pop_result { CAS_FAILED, EMPTY, SUCCESS };
 
-    bool try_push(reference value);
-    pop_result try_pop(pointer& out);
-    bool eliminate_push(reference value);
-    bool eliminate_pop(pointer& out);
-    bool exchange(pointer ptr, pointer& out);
+    typedef atomic_tagged_ptr<T, tag_type> top_ptr;
+    typedef typename Stats::template recorder<elimination_opts::slots>
+        stats_recorder;
+
+    stats_recorder& recorder() { return *this; }
+    const stats_recorder& recorder() const { return *this; }
+
+    bool try_push(reference first, reference last, pointer& top, tag_type& tag);
+    pop_result try_pop(pointer& top, tag_type& tag);
+    typedef typename elimination_params::operation operation;
 
-    //todo - pad out the array elements
-    typedef lockfree_exchanger<T> /*__attribute__((aligned(64)))*/ padded_exchanger;
-    typedef atomic_tagged_ptr<T> top_ptr;
+    bool eliminate_push(reference value, operation& op);
+    bool eliminate_pop(pointer& out, operation& op);
+    bool exchange(pointer ptr, pointer& out, operation& op);
 
-    top_ptr m_top;
-    padded_exchanger m_exchangers[elimination_opts::slots];
+    Parking& parking() { return *this; }
+
+    // m_top and each elimination slot get cache lines to themselves so that
+    // elimination traffic in one slot does not invalidate its neighbours
+    // or the top of the stack
+    typedef cache_padded<elimination_slot<T, Backoff> > padded_slot;
+
+    cache_padded<top_ptr> m_top;
+    padded_slot m_slots[elimination_opts::slots];
+    elimination_params m_elimination_params;
 };
 
 
-template <typename T, typename E>
-intrusive_lockfree_stack<T, E>::intrusive_lockfree_stack()
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::intrusive_lockfree_stack()
+{
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+void
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::push(reference value)
 {
+    push_chain(value, value);
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 void
-intrusive_lockfree_stack<T, E>::push(reference value)
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::push_chain(
+        reference first, reference last)
 {
+    // a failed try_push leaves the observed top in top/tag so the loop never
+    // has to reload it
+    tag_type tag;
+    pointer top(m_top->get(tag, memory_order_relaxed));
+    // handing part of a chain to a popper would let another push land
+    // between the parts, so only a single value is ever eliminated
+    const bool single(&first == &last);
+    B backoff;
+    operation op(m_elimination_params);
     while(true)
     {
-        if(try_push(value) || eliminate_push(value))
+        if(try_push(first, last, top, tag))
+        {
+            recorder().pushed();
+            parking().notify(single ? 1 : INT_MAX);
+            return;
+        }
+        op.cas_failed();
+        recorder().cas_failed();
+        if(single && eliminate_push(first, op))
+        {
+            recorder().pushed();
             return;
+        }
+        backoff();
     }
 }
 
 
-template <typename T, typename E>
-typename intrusive_lockfree_stack<T, E>::pointer
-intrusive_lockfree_stack<T, E>::pop()
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+template <typename ForwardIterator>
+void
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::push_range(
+        ForwardIterator begin, ForwardIterator end)
 {
+    if(begin == end)
+        return;
+    ForwardIterator last(begin);
+    for(ForwardIterator it(begin); ++it != end; last = it)
+        mpm_lfs_set_next(*last, &*it);
+    push_chain(*begin, *last);
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pointer
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pop()
+{
+    typename R::guard guard;
+    // acquire pairs with the release in try_push so that the next pointer
+    // of top is visible before it is read
+    tag_type tag;
+    pointer top(m_top->get(tag, memory_order_acquire));
     pointer out(NULL);
+    B backoff;
+    operation op(m_elimination_params);
     while(true)
     {
-        switch(try_pop(out))
+        top = guard.protect(top, tag, *m_top);
+        switch(try_pop(top, tag))
         {
-            case SUCCESS : return out;
-            case EMPTY   : return NULL;
+            case SUCCESS : recorder().popped(true);  return top;
+            case EMPTY   : recorder().popped(false); return NULL;
             case CAS_FAILED :
-                if(eliminate_pop(out)) return out;
+                op.cas_failed();
+                recorder().cas_failed();
+                if(eliminate_pop(out, op))
+                {
+                    recorder().popped(true);
+                    return out;
+                }
+                backoff();
                 break;
             default:
                 assert(false);
@@ -142,96 +548,167 @@ intrusive_lockfree_stack<T, E>::pop()
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pointer
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pop_wait()
+{
+    return parking().wait(*this, NULL);
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pointer
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pop_wait_for(uint64_t timeout_ns)
+{
+    return parking().wait(*this, &timeout_ns);
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pointer
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pop_all()
+{
+    // bump the tag rather than resetting it so that tags only ever move
+    // forward. Acquire pairs with the release in try_push so that the links
+    // of the whole chain are visible to the caller. Nothing is dereferenced
+    // so there is nothing to protect.
+    tag_type tag;
+    pointer top(m_top->get(tag, memory_order_acquire));
+    while(top && !m_top->compare_exchange_weak(top, NULL, tag, tag + 1,
+                memory_order_acquire))
+        ;
+    return top;
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 void
-intrusive_lockfree_stack<T, E>::clear()
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::clear()
 {
-    m_top.set(NULL, 0);
+    pop_all();
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 bool
-intrusive_lockfree_stack<T, E>::empty() const
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::empty() const
+{
+    tag_type _;
+    return NULL == m_top->get(_, memory_order_relaxed);
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::elimination_params&
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::elimination_parameters()
+{
+    return m_elimination_params;
+}
+
+
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+stack_stats
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::stats() const
 {
-    typename top_ptr::tag_type _;
-    return NULL == m_top.get(_);
+    return recorder().snapshot();
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 bool
-intrusive_lockfree_stack<T, E>::try_push(reference value)
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::try_push(
+        reference first, reference last, pointer& top, tag_type& tag)
 {
-    typename top_ptr::tag_type old_tag;
-    pointer old_top(m_top.get(old_tag));
-    mpm_lfs_set_next(value, old_top);
-    return m_top.compare_and_swap(old_top, &value, old_tag, old_tag + 1);
+    mpm_lfs_set_next(last, top);
+    // strong because a failure sends us into the elimination array. Release
+    // publishes the links of the whole chain along with first; a parking
+    // policy may ask for more to order it before its notify()
+    return m_top->compare_exchange_strong(top, &first, tag, tag + 1,
+            parking_type::push_order());
 }
 
 
-template <typename T, typename E>
-typename intrusive_lockfree_stack<T, E>::pop_result
-intrusive_lockfree_stack<T, E>::try_pop(pointer& out)
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
+typename intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::pop_result
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::try_pop(pointer& top, tag_type& tag)
 {
-    typename top_ptr::tag_type old_tag;
-    out = m_top.get(old_tag);
-    if(NULL == out)
+    if(NULL == top)
         return EMPTY;
-    pointer new_top(mpm_lfs_get_next(*out));
-    return m_top.compare_and_swap(
-            out, new_top, old_tag, old_tag + 1) ? SUCCESS : CAS_FAILED;
+    pointer new_top(mpm_lfs_get_next(*top));
+    // acquire on failure too as the observed top is dereferenced next time
+    return m_top->compare_exchange_strong(top, new_top, tag, tag + 1,
+            memory_order_acquire) ? SUCCESS : CAS_FAILED;
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 bool
-intrusive_lockfree_stack<T, E>::eliminate_push(reference value)
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::eliminate_push(
+        reference value, operation& op)
 {
-    pointer out(NULL);
-    return exchange(&value, out) && out == NULL;
+    pointer unused(NULL);
+    return exchange(&value, unused, op);
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 bool
-intrusive_lockfree_stack<T, E>::eliminate_pop(pointer& ptr)
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::eliminate_pop(
+        pointer& ptr, operation& op)
 {
-    return exchange(NULL, ptr) && ptr;
+    return exchange(NULL, ptr, op);
 }
 
 
 namespace detail {
 
-    inline unsigned int cycle_count_low_bits()
-    {
-        unsigned int lo, hi;
-        __asm__ __volatile__("rdtsc":"=a"(lo), "=d"(hi));
-        return lo;
-    }
-
     //if either the number of elimination slots or the number of elimination
     //attempts is zero, compile the elimination out alltogether
 
-    template <typename T, typename Elim, typename Arr>
+    template <typename T, typename Elim, typename Arr, typename Params,
+             typename Op, typename Stats>
     inline
-    typename mpm::enable_if<
-        Elim::slots == 0 || Elim::attempts == 0, bool>::type
-    exchange(T*, T*&, Arr&)
+    typename mpm::enable_if<!Elim::enabled, bool>::type
+    exchange(T*, T*&, Arr&, const Params&, Op&, Stats&)
     {
         return false;
     }
 
 
-    template <typename T, typename Elim, typename Arr>
-    typename mpm::disable_if<
-        Elim::slots == 0 || Elim::attempts == 0, bool>::type
-    exchange(T* p, T*& out, Arr& exchangers)
+    template <typename T, typename Elim, typename Arr, typename Params,
+             typename Op, typename Stats>
+    typename mpm::disable_if<!Elim::enabled, bool>::type
+    exchange(T* p, T*& out, Arr& slots, const Params& params, Op& op,
+            Stats& stats)
     {
-        for(unsigned int attempts = 0; attempts < Elim::attempts; attempts++)
+        typedef typename Elim::range_policy range;
+        const std::size_t nslots(params.slots());
+        const unsigned int nattempts(params.attempts());
+        const unsigned int timeout(params.timeout());
+        for(unsigned int attempts = 0; attempts < nattempts; attempts++)
         {
-            std::size_t index(detail::cycle_count_low_bits() % Elim::slots);
-            if(exchangers[index].exchange(p, out, Elim::timeout))
+            std::size_t index(Elim::slot_selector::select(
+                        range::width(nslots)));
+            // a NULL p is a pop
+            typename Elim::deadline_type deadline(timeout);
+            exchange_result result(p ?
+                    slots[index]->push_until(p, deadline) :
+                    slots[index]->pop_until(out, deadline));
+            range::record(nslots, result);
+            op.eliminated(result);
+            stats.eliminated(index, result);
+            if(exchange_success == result)
                 return true;
         }
         return false;
@@ -239,25 +716,32 @@ namespace detail {
 }
 
 
-template <typename T, typename E>
+template <typename T, typename E, typename Tag, typename B, typename R,
+         typename S, typename P>
 bool
-intrusive_lockfree_stack<T, E>::exchange(pointer p, pointer& out)
+intrusive_lockfree_stack<T, E, Tag, B, R, S, P>::exchange(
+        pointer p, pointer& out, operation& op)
 {
-    return detail::exchange<T, E>(p, out, m_exchangers);
+    return detail::exchange<T, E>(
+            p, out, m_slots, m_elimination_params, op, recorder());
 }
 
 
 template <typename T>
 inline void mpm_lfs_set_next(T& entry, T* next)
 {
-    entry.mpm_intrusive_lockfree_stack_next = next;
+    // relaxed atomics because a racing pop may read the next pointer of an
+    // entry that has already been popped and is being pushed again
+    MPM_STORE(&entry.mpm_intrusive_lockfree_stack_next, next,
+            memory_order_relaxed);
 }
 
 
 template <typename T>
 inline T* mpm_lfs_get_next(const T& entry)
 {
-    return entry.mpm_intrusive_lockfree_stack_next;
+    return MPM_LOAD(&entry.mpm_intrusive_lockfree_stack_next,
+            memory_order_relaxed);
 }
 
 
@@ -2,12 +2,31 @@
 
 #include "mpm/atomic.hpp"
 #include "mpm/atomic_tagged_ptr.hpp"
+#include "mpm/backoff.hpp"
+#include "mpm/deadline.hpp"
 #include "mpm/util.hpp"
 #include <cassert>
 
 namespace mpm {
 
-template <typename T>
+/// \brief The outcome of lockfree_exchanger::try_exchange
+enum exchange_result
+{
+    exchange_success,   // swapped pointers with a partner
+
+    exchange_timeout,   // waited in the exchanger for the whole timeout but
+                        // no partner arrived
+
+    exchange_contended  // the timeout expired while other threads were
+                        // occupying the exchanger
+};
+
+
+/// \brief Allows two threads to swap pointers
+///
+/// Backoff is invoked on every spin while waiting for a partner and while
+/// waiting out two other threads that are mid-exchange; see backoff.hpp.
+template <typename T, typename Backoff=no_backoff>
 class lockfree_exchanger
 {
 public:
@@ -19,6 +38,16 @@ public:
 
     bool exchange(ptr_type my_ptr, ref_ptr_type out_val, unsigned int timeout);
 
+    /// \brief As exchange() but reports why an exchange did not happen
+    exchange_result try_exchange(
+            ptr_type my_ptr, ref_ptr_type out_val, unsigned int timeout);
+
+    /// \brief As try_exchange() but waits until deadline expires rather than
+    /// for a number of spins; see deadline.hpp
+    template <typename Deadline>
+    exchange_result try_exchange_until(
+            ptr_type my_ptr, ref_ptr_type out_val, Deadline deadline);
+
 private:
     MPM_DISALLOW_COPY_AND_ASSIGN(lockfree_exchanger);
     enum {
@@ -35,69 +64,98 @@ private:
 };
 
 
-template <typename T>
-lockfree_exchanger<T>::lockfree_exchanger() : m_slot(0, EMPTY)
+template <typename T, typename B>
+lockfree_exchanger<T, B>::lockfree_exchanger() : m_slot(0, EMPTY)
 {
 }
 
 
-template <typename T>
+template <typename T, typename B>
 bool
-lockfree_exchanger<T>::exchange(
+lockfree_exchanger<T, B>::exchange(
         ptr_type my_ptr, ref_ptr_type out_val, unsigned int timeout)
+{
+    return exchange_success == try_exchange(my_ptr, out_val, timeout);
+}
+
+
+template <typename T, typename B>
+exchange_result
+lockfree_exchanger<T, B>::try_exchange(
+        ptr_type my_ptr, ref_ptr_type out_val, unsigned int timeout)
+{
+    return try_exchange_until(my_ptr, out_val, spin_deadline(timeout));
+}
+
+
+template <typename T, typename B>
+template <typename Deadline>
+exchange_result
+lockfree_exchanger<T, B>::try_exchange_until(
+        ptr_type my_ptr, ref_ptr_type out_val, Deadline deadline)
 {
     typename atomic_tagged_ptr<value_type>::tag_type tag;
+    B backoff;
 
-    for(unsigned int attempts = 0; attempts < timeout; attempts++)
+    // acquire so that a partner's pointer is safe to hand back. Failed CAS
+    // attempts below write the observed slot back into existing_ptr and tag
+    // so the slot is only reloaded when there is nothing to CAS against.
+    ptr_type existing_ptr(m_slot.get(tag, memory_order_acquire));
+    while(!deadline.expired())
     {
-        ptr_type existing_ptr(m_slot.get(tag));
         switch(tag)
         {
             case EMPTY:
-                if(m_slot.compare_and_swap(
-                            existing_ptr, my_ptr, EMPTY, WAITING))
+                // release to publish my_ptr to whoever picks it up
+                if(m_slot.compare_exchange_weak(existing_ptr, my_ptr, tag,
+                            WAITING, memory_order_release))
                 {
                     // slot was not already set so the tag gets set to
                     // WAITING and we spin until an exchange partner
                     // arrives
                     do
                     {
-                        existing_ptr = m_slot.get(tag);
+                        existing_ptr = m_slot.get(tag, memory_order_acquire);
                         if(BUSY == tag)
                         {
                             //a partner has arrived so reset internal
                             //state and exchange pointers
-                            m_slot.set(0, EMPTY);
+                            m_slot.set(0, EMPTY, memory_order_relaxed);
                             out_val = existing_ptr;
-                            return true;
+                            return exchange_success;
                         }
-                    } while(++attempts <= timeout);
+                        backoff();
+                    } while(!deadline.expired());
                     //done spinning but didn't meet with an exchange partner
-                    //try set the internal state back to empty
-                    if(m_slot.compare_and_swap(my_ptr, 0, WAITING, EMPTY))
+                    //try set the internal state back to empty. This must be
+                    //a strong CAS as a failure means a partner has arrived.
+                    existing_ptr = my_ptr;
+                    tag = WAITING;
+                    if(m_slot.compare_exchange_strong(existing_ptr, 0, tag,
+                                EMPTY, memory_order_acquire))
                     {
-                        return false;
+                        return exchange_timeout;
                     }
                     else
                     {
                         //done spinning but found an exchange partner while
                         //trying to set the state back to EMPTY.
-                        out_val = m_slot.get(tag);
-                        m_slot.set(0, EMPTY);
-                        return true;
+                        out_val = existing_ptr;
+                        m_slot.set(0, EMPTY, memory_order_relaxed);
+                        return exchange_success;
                     }
                 }
                 break;
             case WAITING:
                 //another thread is already in here and no third thread has
                 //yet transitioned this exchanger into the BUSY state
-                if(m_slot.compare_and_swap(
-                            existing_ptr, my_ptr, WAITING, BUSY))
+                if(m_slot.compare_exchange_weak(existing_ptr, my_ptr, tag,
+                            BUSY, memory_order_acq_rel))
                 {
                     //the current thread and some other thread have agreed
                     //to swap pointers
                     out_val = existing_ptr;
-                    return true;
+                    return exchange_success;
                 }
                 break;
             case BUSY:
@@ -106,12 +164,14 @@ lockfree_exchanger<T>::exchange(
                 //The state will soon turn back to EMPTY (after the
                 //pointers have been exchanged) so just break to the next
                 //loop iteration.
+                backoff();
+                existing_ptr = m_slot.get(tag, memory_order_acquire);
                 break;
             default:
                 assert(false);
         }
     }
-    return false;
+    return exchange_contended;
 }
 
 }
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "mpm/deadline.hpp"
+#include "mpm/intrusive_lockfree_mpsc_queue.hpp"
+#include "mpm/util.hpp"
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+namespace mpm {
+
+/// \brief Collects one producer's values into a chain and pushes them into
+/// an intrusive_lockfree_mpsc_queue together
+///
+/// Each flush costs a single exchange on the queue's head however many
+/// values it carries, but a value waits in the chain, invisible to the
+/// consumer, until its batch is flushed. The chain is flushed when
+///  (1) it holds max_batch values,
+///  (2) a value is pushed or flush_if_expired() is called more than
+///      max_delay_ns nanoseconds after the oldest value in the chain was
+///      pushed,
+///  (3) flush() is called, or
+///  (4) the producer is destroyed.
+/// A large max_batch and no deadline give the best throughput; a max_batch
+/// of 1 pushes every value straight through. A producer that may go idle
+/// with values in the chain should call flush() or flush_if_expired() when
+/// it does.
+///
+/// A producer belongs to the one thread that pushes through it; give each
+/// producing thread its own. The deadline is measured with the time stamp
+/// counter; a producer with a deadline calls calibrate_tsc() when it is
+/// constructed, which spins for a few milliseconds if nothing has yet.
+template <typename T, typename Layout=mpsc_padded_layout,
+         typename Wait=pause_wait>
+class mpsc_batching_producer
+{
+public:
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef T& reference;
+    typedef intrusive_lockfree_mpsc_queue<T, Layout, Wait> queue_type;
+
+    /// pass as max_delay_ns to only flush on size
+    static const uint64_t no_deadline = ~uint64_t(0);
+
+    explicit mpsc_batching_producer(queue_type& queue,
+            std::size_t max_batch=32, uint64_t max_delay_ns=no_deadline);
+
+    /// \brief Flushes whatever is left in the chain
+    ~mpsc_batching_producer();
+
+    /// \brief Appends value to the chain, flushing it if it is full or its
+    /// oldest value has waited too long
+    void push(reference value);
+
+    /// \brief Pushes the chain into the queue, if it holds anything
+    void flush();
+
+    /// \brief Flushes the chain if its oldest value has waited longer than
+    /// max_delay_ns
+    /// \returns true if the chain was flushed
+    bool flush_if_expired();
+
+    /// \returns the number of values waiting in the chain
+    std::size_t pending() const;
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(mpsc_batching_producer);
+
+    static uint64_t to_ticks(uint64_t ns);
+    bool expired() const;
+
+    queue_type& m_queue;
+    const std::size_t m_max_batch;
+    const uint64_t m_max_delay_ticks;
+    pointer m_first;
+    pointer m_last;
+    std::size_t m_count;
+    uint64_t m_oldest;
+};
+
+
+template <typename T, typename L, typename W>
+const uint64_t mpsc_batching_producer<T, L, W>::no_deadline;
+
+
+template <typename T, typename L, typename W>
+mpsc_batching_producer<T, L, W>::mpsc_batching_producer(queue_type& queue,
+        std::size_t max_batch, uint64_t max_delay_ns) :
+    m_queue(queue), m_max_batch(max_batch),
+    m_max_delay_ticks(to_ticks(max_delay_ns)),
+    m_first(0), m_last(0), m_count(0), m_oldest(0)
+{
+    assert(max_batch > 0);
+}
+
+
+template <typename T, typename L, typename W>
+mpsc_batching_producer<T, L, W>::~mpsc_batching_producer()
+{
+    flush();
+}
+
+
+template <typename T, typename L, typename W>
+void
+mpsc_batching_producer<T, L, W>::push(reference value)
+{
+    if(m_last)
+        mpm_intrusive_lockfree_mpsc_queue_set_next(*m_last, &value);
+    else
+    {
+        m_first = &value;
+        if(no_deadline != m_max_delay_ticks)
+            m_oldest = detail::read_tsc();
+    }
+    m_last = &value;
+    if(++m_count >= m_max_batch || expired())
+        flush();
+}
+
+
+template <typename T, typename L, typename W>
+void
+mpsc_batching_producer<T, L, W>::flush()
+{
+    if(!m_first)
+        return;
+    m_queue.push_chain(*m_first, *m_last);
+    m_first = m_last = 0;
+    m_count = 0;
+}
+
+
+template <typename T, typename L, typename W>
+bool
+mpsc_batching_producer<T, L, W>::flush_if_expired()
+{
+    if(!m_first || !expired())
+        return false;
+    flush();
+    return true;
+}
+
+
+template <typename T, typename L, typename W>
+std::size_t
+mpsc_batching_producer<T, L, W>::pending() const
+{
+    return m_count;
+}
+
+
+template <typename T, typename L, typename W>
+uint64_t
+mpsc_batching_producer<T, L, W>::to_ticks(uint64_t ns)
+{
+    if(no_deadline == ns)
+        return no_deadline;
+    // a delay too long to count in ticks is as good as none; converting
+    // such a double to uint64_t would be undefined
+    double ticks(ns * calibrate_tsc());
+    return ticks < 18446744073709551615.0 ? uint64_t(ticks) : no_deadline;
+}
+
+
+template <typename T, typename L, typename W>
+bool
+mpsc_batching_producer<T, L, W>::expired() const
+{
+    return no_deadline != m_max_delay_ticks &&
+        detail::read_tsc() - m_oldest >= m_max_delay_ticks;
+}
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/deadline.hpp"
+#include "mpm/futex.hpp"
+#include "mpm/util.hpp"
+#include <stdint.h>
+
+namespace mpm {
+
+/// \file
+/// Policies that decide whether, and how, poppers of an
+/// intrusive_lockfree_stack can sleep while it is empty.
+///
+/// A parking policy is a base of its stack. It provides push_order(), the
+/// memory order of the CAS that publishes a push, and notify(count), which
+/// every successful push calls. A policy that supports blocking also
+/// provides wait(stack, timeout_ns), which the stack's pop_wait() and
+/// pop_wait_for() hand themselves to; a stack whose policy does not cannot
+/// call them.
+
+
+/// \brief The default parking policy: poppers never sleep
+///
+/// Takes no space and costs pushes nothing beyond their release CAS. The
+/// stack's pop_wait() and pop_wait_for() do not compile with it.
+struct no_parking
+{
+    static memory_order push_order() { return memory_order_release; }
+    void notify(int) {}
+};
+
+
+/// \brief Lets poppers sleep on a futex while the stack is empty
+///
+/// A waiting popper retries pop() Spins times and then announces itself in
+/// a waiter count and sleeps. Every push pays for the handshake with the
+/// count: its CAS is seq_cst instead of release, which is free on x86 where
+/// the CAS is a full barrier anyway, and it loads the count afterwards. It
+/// only makes a system call while some popper is asleep. The count and the
+/// futex word share a cache line of their own, which pushes only read.
+template <unsigned int Spins=64>
+class futex_parking
+{
+public:
+    futex_parking() {}
+
+    static memory_order push_order() { return memory_order_seq_cst; }
+
+    /// \brief Wakes up to count sleeping poppers, if there are any
+    void notify(int count);
+
+    /// \brief Pops from stack, sleeping while it is empty, for at most
+    /// *timeout_ns nanoseconds unless timeout_ns is NULL
+    template <typename Stack>
+    typename Stack::pointer wait(Stack& stack, const uint64_t* timeout_ns);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(futex_parking);
+
+    // waiters counts the threads in wait() past their spinning phase; they
+    // sleep on sequence, which a push bumps whenever waiters is non-zero
+    struct state
+    {
+        state() : waiters(0), sequence(0) {}
+        uint32_t waiters;
+        uint32_t sequence;
+    };
+
+    cache_padded<state> m_state;
+};
+
+
+template <unsigned int S>
+void
+futex_parking<S>::notify(int count)
+{
+    state& p(*m_state);
+    // seq_cst pairs with the fence in wait(); see there
+    if(0 == MPM_LOAD(&p.waiters, memory_order_seq_cst))
+        return;
+    MPM_FETCH_ADD(&p.sequence, 1u, memory_order_release);
+    detail::futex_wake(&p.sequence, count);
+}
+
+
+template <unsigned int S>
+template <typename Stack>
+typename Stack::pointer
+futex_parking<S>::wait(Stack& stack, const uint64_t* timeout_ns)
+{
+    typename Stack::pointer value;
+    for(unsigned int i = 0; i < S; i++)
+    {
+        if((value = stack.pop()))
+            return value;
+        MPM_CPU_RELAX();
+    }
+
+    const uint64_t start(timeout_ns ? detail::monotonic_ns() : 0);
+    state& p(*m_state);
+    MPM_FETCH_ADD(&p.waiters, 1u, memory_order_seq_cst);
+    // pairs with the seq_cst push CAS and the load in notify(): either a
+    // pusher sees us waiting or our next pop() sees its value
+    MPM_FENCE(memory_order_seq_cst);
+
+    while(true)
+    {
+        // acquire keeps the pop below from being satisfied before the
+        // sequence is read, which would let a wakeup slip in between
+        uint32_t sequence(MPM_LOAD(&p.sequence, memory_order_acquire));
+        if((value = stack.pop()))
+            break;
+
+        uint64_t remaining(0);
+        if(timeout_ns)
+        {
+            uint64_t elapsed(detail::monotonic_ns() - start);
+            if(elapsed >= *timeout_ns)
+                break;
+            remaining = *timeout_ns - elapsed;
+        }
+        detail::futex_wait(&p.sequence, sequence,
+                timeout_ns ? &remaining : NULL);
+    }
+
+    MPM_FETCH_ADD(&p.waiters, uint32_t(-1), memory_order_relaxed);
+    return value;
+}
+
+}
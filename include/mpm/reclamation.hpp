@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/atomic_tagged_ptr.hpp"
+#include "mpm/thread_registry.hpp"
+#include "mpm/util.hpp"
+
+namespace mpm {
+
+/// \brief The default reclamation policy for the lock-free datastructures
+///
+/// Does nothing, so entries must outlive every thread that might still be
+/// reading them (e.g. by coming from a type-stable pool).
+///
+/// A reclamation policy provides a nested guard type which an operation
+/// constructs before it first reads a shared pointer and destroys once it
+/// is done. guard::protect(observed, tag, src) is handed each value that the
+/// operation is about to dereference, along with the atomic it was read
+/// from, and returns a value (and tag) that is safe to dereference until the
+/// guard is destroyed or protect() is called again. See
+/// hazard_pointer_reclamation and epoch_reclamation.
+struct no_reclamation
+{
+    class guard
+    {
+    public:
+        template <typename T, typename Tag>
+        T* protect(T* observed, Tag&, const atomic_tagged_ptr<T, Tag>&)
+        {
+            return observed;
+        }
+    };
+};
+
+
+namespace detail {
+
+    struct retired_ptr
+    {
+        void* ptr;
+        void (*deleter)(void*);
+    };
+
+
+    template <typename T>
+    void delete_object(void* ptr)
+    {
+        delete static_cast<T*>(ptr);
+    }
+}
+
+}
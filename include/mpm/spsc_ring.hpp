@@ -0,0 +1,218 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/util.hpp"
+#include <cstddef>
+
+namespace mpm {
+
+/// \brief A bounded wait-free SPSC queue that stores values in a ring
+///
+/// The producer owns the tail and the consumer owns the head; neither side
+/// needs an atomic read-modify-write. Each side also keeps a copy of the
+/// other's index and only reloads the real one when the copy makes the ring
+/// look full (to the producer) or empty (to the consumer), so while the
+/// ring is neither the two sides do not touch each other's lines at all.
+///
+/// The layout is two padded lines, one per side, each holding the index
+/// that side publishes together with its cached copy of the other side's
+/// index. The cached copy is not on a private line of its own: a reload
+/// pulls in the other side's line, cached copy included, but that line is
+/// wanted for the index anyway, and the cached copy is only written by its
+/// owner right after a reload, so keeping it there adds little traffic and
+/// saves a line per side.
+///
+/// Besides copying single values in and out, the producer can reserve()
+/// a run of free slots, fill them in place and commit() them together, and
+/// the consumer can peek() at a run of values, use them in place and
+/// consume() them together. Each of these publishes a whole batch with a
+/// single store.
+///
+/// Exactly one thread may push and one thread may pop. T must be default
+/// constructible and assignable. Capacity must be a power of two.
+template <typename T, std::size_t Capacity>
+class spsc_ring
+{
+public:
+
+    typedef T value_type;
+    typedef T* pointer;
+
+    static const std::size_t capacity = Capacity;
+
+    spsc_ring();
+
+    /// \brief Copies value into the ring if there is room. Producer only.
+    /// \returns false if the ring was full
+    bool try_push(const value_type& value);
+
+    /// \brief Finds up to max free slots for the producer to fill in place
+    /// Producer only. The slots are contiguous, so fewer than are free may
+    /// be returned where the ring wraps around. They hold whatever was last
+    /// popped from them.
+    ///
+    /// \param[out] first the first of the slots
+    /// \returns the number of slots reserved
+    std::size_t reserve(pointer& first, std::size_t max);
+
+    /// \brief Publishes the first n slots returned by the last reserve() to
+    /// the consumer. Producer only.
+    void commit(std::size_t n);
+
+    /// \brief Copies the value at the front of the ring into out and
+    /// removes it. Consumer only.
+    /// \returns false if the ring was empty
+    bool try_pop(value_type& out);
+
+    /// \brief Finds up to max values at the front of the ring for the
+    /// consumer to use in place. Consumer only. The values are contiguous,
+    /// so fewer than are available may be returned where the ring wraps
+    /// around.
+    ///
+    /// \param[out] first the value at the front of the ring
+    /// \returns the number of values found
+    std::size_t peek(pointer& first, std::size_t max);
+
+    /// \brief Removes the first n values returned by the last peek(),
+    /// handing their slots back to the producer. Consumer only.
+    void consume(std::size_t n);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(spsc_ring);
+    MPM_STATIC_ASSERT(Capacity > 0 && 0 == (Capacity & (Capacity - 1)));
+
+    static const std::size_t mask = Capacity - 1;
+
+    // the index a side publishes shares a line with its cached copy of the
+    // other side's index, which only it reads or writes; see above
+    struct producer_state
+    {
+        std::size_t tail;
+        std::size_t cached_head;
+    };
+
+    struct consumer_state
+    {
+        std::size_t head;
+        std::size_t cached_tail;
+    };
+
+    static std::size_t contiguous(std::size_t index, std::size_t available,
+            std::size_t max);
+
+    cache_padded<producer_state> m_producer;
+    cache_padded<consumer_state> m_consumer;
+    value_type m_slots[Capacity];
+};
+
+
+template <typename T, std::size_t C>
+const std::size_t spsc_ring<T, C>::capacity;
+
+
+template <typename T, std::size_t C>
+spsc_ring<T, C>::spsc_ring()
+{
+    m_producer->tail = m_producer->cached_head = 0;
+    m_consumer->head = m_consumer->cached_tail = 0;
+}
+
+
+template <typename T, std::size_t C>
+bool
+spsc_ring<T, C>::try_push(const value_type& value)
+{
+    pointer slot;
+    if(0 == reserve(slot, 1))
+        return false;
+    *slot = value;
+    commit(1);
+    return true;
+}
+
+
+template <typename T, std::size_t C>
+std::size_t
+spsc_ring<T, C>::reserve(pointer& first, std::size_t max)
+{
+    producer_state& p(*m_producer);
+    // only we write the tail, so a relaxed load sees our last store
+    std::size_t tail(MPM_LOAD(&p.tail, memory_order_relaxed));
+    std::size_t free(C - (tail - p.cached_head));
+    if(free < max)
+    {
+        // acquire pairs with the release in consume so that the consumer
+        // is done with the slots before we refill them
+        p.cached_head = MPM_LOAD(&m_consumer->head, memory_order_acquire);
+        free = C - (tail - p.cached_head);
+    }
+    first = &m_slots[tail & mask];
+    return contiguous(tail, free, max);
+}
+
+
+template <typename T, std::size_t C>
+void
+spsc_ring<T, C>::commit(std::size_t n)
+{
+    producer_state& p(*m_producer);
+    // release publishes the contents of the slots to the consumer
+    MPM_STORE(&p.tail, MPM_LOAD(&p.tail, memory_order_relaxed) + n,
+            memory_order_release);
+}
+
+
+template <typename T, std::size_t C>
+bool
+spsc_ring<T, C>::try_pop(value_type& out)
+{
+    pointer slot;
+    if(0 == peek(slot, 1))
+        return false;
+    out = *slot;
+    consume(1);
+    return true;
+}
+
+
+template <typename T, std::size_t C>
+std::size_t
+spsc_ring<T, C>::peek(pointer& first, std::size_t max)
+{
+    consumer_state& c(*m_consumer);
+    std::size_t head(MPM_LOAD(&c.head, memory_order_relaxed));
+    std::size_t available(c.cached_tail - head);
+    if(available < max)
+    {
+        // acquire pairs with the release in commit
+        c.cached_tail = MPM_LOAD(&m_producer->tail, memory_order_acquire);
+        available = c.cached_tail - head;
+    }
+    first = &m_slots[head & mask];
+    return contiguous(head, available, max);
+}
+
+
+template <typename T, std::size_t C>
+void
+spsc_ring<T, C>::consume(std::size_t n)
+{
+    consumer_state& c(*m_consumer);
+    // release so that we are done with the slots before the producer
+    // refills them
+    MPM_STORE(&c.head, MPM_LOAD(&c.head, memory_order_relaxed) + n,
+            memory_order_release);
+}
+
+
+template <typename T, std::size_t C>
+std::size_t
+spsc_ring<T, C>::contiguous(std::size_t index, std::size_t available,
+        std::size_t max)
+{
+    std::size_t to_end(C - (index & mask));
+    std::size_t n(available < to_end ? available : to_end);
+    return n < max ? n : max;
+}
+
+}
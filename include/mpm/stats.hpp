@@ -0,0 +1,217 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/lockfree_exchanger.hpp"
+#include "mpm/thread_registry.hpp"
+#include "mpm/util.hpp"
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace mpm {
+
+/// \brief A snapshot of the contention seen by an intrusive_lockfree_stack
+struct stack_stats
+{
+    explicit stack_stats(std::size_t slots=0) :
+        pushes(0), pops(0), empty_pops(0), cas_failures(0),
+        elimination_hits(0), elimination_timeouts(0),
+        elimination_collisions(0), slot_hits(slots, 0)
+    {
+    }
+
+    /// \brief Adds the counts in other to these
+    stack_stats& merge(const stack_stats& other)
+    {
+        pushes += other.pushes;
+        pops += other.pops;
+        empty_pops += other.empty_pops;
+        cas_failures += other.cas_failures;
+        elimination_hits += other.elimination_hits;
+        elimination_timeouts += other.elimination_timeouts;
+        elimination_collisions += other.elimination_collisions;
+        if(slot_hits.size() < other.slot_hits.size())
+            slot_hits.resize(other.slot_hits.size(), 0);
+        for(std::size_t i = 0; i < other.slot_hits.size(); i++)
+            slot_hits[i] += other.slot_hits[i];
+        return *this;
+    }
+
+    /// push() and push_chain() calls, completed on the stack or eliminated
+    uint64_t pushes;
+
+    /// pop() calls that returned a value
+    uint64_t pops;
+
+    /// pop() calls that found the stack empty
+    uint64_t empty_pops;
+
+    /// failed CAS attempts on the top of the stack
+    uint64_t cas_failures;
+
+    /// elimination attempts that met a partner
+    uint64_t elimination_hits;
+
+    /// elimination attempts that waited out their timeout alone
+    uint64_t elimination_timeouts;
+
+    /// elimination attempts that found their slot occupied by other threads
+    /// for the whole timeout, or by the same operation
+    uint64_t elimination_collisions;
+
+    /// elimination hits by slot
+    std::vector<uint64_t> slot_hits;
+};
+
+
+/// \brief The default statistics policy for intrusive_lockfree_stack, which
+/// records nothing
+///
+/// A statistics policy provides a nested template recorder<Slots>, a member
+/// of every stack with Slots elimination slots, which is told of every
+/// push, pop, failed CAS and elimination attempt and can produce a
+/// stack_stats snapshot.
+struct no_stats
+{
+    template <std::size_t Slots>
+    class recorder
+    {
+    public:
+        void pushed() {}
+        void popped(bool) {}
+        void cas_failed() {}
+        void eliminated(std::size_t, exchange_result) {}
+
+        stack_stats snapshot() const { return stack_stats(Slots); }
+    };
+};
+
+
+namespace detail {
+    // the stack derives from its recorder, so an empty no_stats recorder
+    // adds nothing to its size
+    struct no_stats_probe : no_stats::recorder<1> { char c; };
+    MPM_STATIC_ASSERT(1 == sizeof(no_stats_probe));
+}
+
+
+/// \brief Statistics policy that counts everything
+///
+/// Each thread counts into cache-padded counters of its own, so recording
+/// costs a thread-local lookup and a few uncontended stores but never
+/// bounces a cache line between threads. snapshot() sums the counters of
+/// every thread that has used the stack, including ones that have since
+/// exited, and may run concurrently with the stack's operations.
+struct contention_stats
+{
+    template <std::size_t Slots>
+    class recorder
+    {
+    public:
+        void pushed() { bump(local().pushes); }
+        void cas_failed() { bump(local().cas_failures); }
+
+        void popped(bool found)
+        {
+            counters& c(local());
+            bump(found ? c.pops : c.empty_pops);
+        }
+
+        void eliminated(std::size_t slot, exchange_result result)
+        {
+            counters& c(local());
+            switch(result)
+            {
+                case exchange_success:
+                    bump(c.elimination_hits);
+                    bump(c.slot_hits[slot]);
+                    break;
+                case exchange_timeout:
+                    bump(c.elimination_timeouts);
+                    break;
+                default:
+                    bump(c.elimination_collisions);
+                    break;
+            }
+        }
+
+        stack_stats snapshot() const;
+
+    private:
+        struct counters
+        {
+            uint64_t pushes;
+            uint64_t pops;
+            uint64_t empty_pops;
+            uint64_t cas_failures;
+            uint64_t elimination_hits;
+            uint64_t elimination_timeouts;
+            uint64_t elimination_collisions;
+            uint64_t slot_hits[Slots ? Slots : 1];
+        };
+
+        // records are allocated with plain operator new, which ignores
+        // over-alignment, so the counters are padded rather than aligned
+        struct record
+        {
+            record() : active(true), next(0)
+            {
+                counters zero = {};
+                m_counters = zero;
+            }
+
+            void on_thread_exit() {}
+
+            counters& get() { return m_counters; }
+            const counters& get() const { return m_counters; }
+
+            bool active;
+            record* next;
+
+        private:
+            char m_pad_front[MPM_CACHELINE_SIZE];
+            counters m_counters;
+            char m_pad_back[MPM_CACHELINE_SIZE];
+        };
+
+        counters& local() { return m_records.local().get(); }
+
+        // only the owning thread writes a counter; the atomic store keeps
+        // concurrent snapshots from reading a torn value
+        static void bump(uint64_t& counter)
+        {
+            MPM_STORE(&counter, counter + 1, memory_order_relaxed);
+        }
+
+        static uint64_t read(const uint64_t& counter)
+        {
+            return MPM_LOAD(&counter, memory_order_relaxed);
+        }
+
+        detail::thread_registry<record> m_records;
+    };
+};
+
+
+template <std::size_t Slots>
+stack_stats
+contention_stats::recorder<Slots>::snapshot() const
+{
+    stack_stats stats(Slots);
+    for(const record* r = m_records.first(); r; r = r->next)
+    {
+        const counters& c(r->get());
+        stats.pushes += read(c.pushes);
+        stats.pops += read(c.pops);
+        stats.empty_pops += read(c.empty_pops);
+        stats.cas_failures += read(c.cas_failures);
+        stats.elimination_hits += read(c.elimination_hits);
+        stats.elimination_timeouts += read(c.elimination_timeouts);
+        stats.elimination_collisions += read(c.elimination_collisions);
+        for(std::size_t i = 0; i < Slots; i++)
+            stats.slot_hits[i] += read(c.slot_hits[i]);
+    }
+    return stats;
+}
+
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/util.hpp"
+#include <cstddef>
+#include <pthread.h>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+namespace mpm {
+
+namespace detail {
+
+    /// \brief Finds the calling thread's record in any thread_registry
+    ///
+    /// Every thread keeps a table of the records it holds, one per registry,
+    /// behind a __thread pointer. A single process-wide pthread key releases
+    /// them when the thread exits, so the number of registries is not
+    /// limited by PTHREAD_KEYS_MAX. Registries are told apart by ids that
+    /// are never reused: a thread's entry for a registry that has since been
+    /// destroyed is never matched again, is not released at exit and is
+    /// pruned the next time the thread adds an entry.
+    class thread_registry_slots
+    {
+    public:
+        typedef void (*release_fn)(void* record);
+
+        /// \returns the id of a new registry
+        static uint64_t open();
+
+        /// \brief Retires a registry's id. Once this returns no exiting
+        /// thread will release a record of that registry.
+        static void close(uint64_t id);
+
+        /// \returns the calling thread's record in registry id, or NULL
+        static void* get(uint64_t id);
+
+        /// \brief Makes record the calling thread's record in registry id;
+        /// release will be called on it when the thread exits
+        static void set(uint64_t id, void* record, release_fn release);
+
+    private:
+        struct entry
+        {
+            uint64_t id;
+            void* record;
+            release_fn release;
+        };
+
+        typedef std::vector<entry> table;
+
+        struct shared
+        {
+            pthread_mutex_t lock;
+            std::set<uint64_t> live;
+            uint64_t next_id;
+            pthread_key_t key;
+            bool have_key;
+        };
+
+        static table*& local();
+        static shared& state();
+        static void on_thread_exit(void* ptr);
+    };
+
+
+    inline uint64_t
+    thread_registry_slots::open()
+    {
+        shared& s(state());
+        pthread_mutex_lock(&s.lock);
+        uint64_t id(s.next_id++);
+        s.live.insert(id);
+        pthread_mutex_unlock(&s.lock);
+        return id;
+    }
+
+
+    inline void
+    thread_registry_slots::close(uint64_t id)
+    {
+        shared& s(state());
+        pthread_mutex_lock(&s.lock);
+        s.live.erase(id);
+        pthread_mutex_unlock(&s.lock);
+    }
+
+
+    inline void*
+    thread_registry_slots::get(uint64_t id)
+    {
+        table* t(local());
+        if(!t)
+            return NULL;
+        for(std::size_t i = 0; i < t->size(); i++)
+            if(id == (*t)[i].id)
+                return (*t)[i].record;
+        return NULL;
+    }
+
+
+    inline void
+    thread_registry_slots::set(uint64_t id, void* record, release_fn release)
+    {
+        shared& s(state());
+        table*& t(local());
+        bool first(!t);
+        if(first)
+            t = new table;
+
+        entry e = { id, record, release };
+        pthread_mutex_lock(&s.lock);
+        std::size_t kept(0);
+        for(std::size_t i = 0; i < t->size(); i++)
+            if(s.live.count((*t)[i].id))
+                (*t)[kept++] = (*t)[i];
+        t->resize(kept);
+        t->push_back(e);
+        pthread_mutex_unlock(&s.lock);
+
+        // without a key the records of this thread are simply never
+        // released for adoption by later threads
+        if(first && s.have_key)
+            pthread_setspecific(s.key, t);
+    }
+
+
+    inline thread_registry_slots::table*&
+    thread_registry_slots::local()
+    {
+        static __thread table* t;
+        return t;
+    }
+
+
+    inline thread_registry_slots::shared&
+    thread_registry_slots::state()
+    {
+        // never destroyed, as threads may exit after static destructors run
+        static shared* s(0);
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        struct init
+        {
+            static void run()
+            {
+                s = new shared;
+                pthread_mutex_init(&s->lock, NULL);
+                s->next_id = 0;
+                s->have_key = 0 == pthread_key_create(
+                        &s->key, &thread_registry_slots::on_thread_exit);
+            }
+        };
+        pthread_once(&once, &init::run);
+        return *s;
+    }
+
+
+    inline void
+    thread_registry_slots::on_thread_exit(void* ptr)
+    {
+        table* t(static_cast<table*>(ptr));
+        shared& s(state());
+        pthread_mutex_lock(&s.lock);
+        for(std::size_t i = 0; i < t->size(); i++)
+            if(s.live.count((*t)[i].id))
+                (*t)[i].release((*t)[i].record);
+        pthread_mutex_unlock(&s.lock);
+        local() = NULL;
+        delete t;
+    }
+
+
+    /// \brief Hands each thread a Record of its own
+    ///
+    /// Records live in a lock-free list that only grows and are freed along
+    /// with the registry. When a thread exits its record is released with
+    /// Record::on_thread_exit() and marked inactive so that it, and whatever
+    /// state it still holds, can be adopted by the next thread that needs
+    /// one.
+    ///
+    /// Record must be default constructible and have public members
+    /// `bool active` (initially true), `Record* next` and
+    /// `void on_thread_exit()`.
+    template <typename Record>
+    class thread_registry
+    {
+    public:
+
+        thread_registry();
+
+        /// Frees every record. No thread may be using the registry
+        /// concurrently.
+        ~thread_registry();
+
+        /// \returns the calling thread's record
+        Record& local();
+
+        /// \returns the first record in the registry; follow Record::next
+        ///          for the rest
+        Record* first() const;
+
+        /// \returns the number of records ever created
+        std::size_t size() const;
+
+    private:
+        MPM_DISALLOW_COPY_AND_ASSIGN(thread_registry);
+
+        Record& adopt();
+        static void release(void* record);
+
+        const uint64_t m_id;
+        Record* m_records;
+        std::size_t m_count;
+    };
+
+
+    template <typename Record>
+    thread_registry<Record>::thread_registry() :
+        m_id(thread_registry_slots::open()), m_records(0), m_count(0)
+    {
+    }
+
+
+    template <typename Record>
+    thread_registry<Record>::~thread_registry()
+    {
+        thread_registry_slots::close(m_id);
+        Record* record(m_records);
+        while(record)
+        {
+            Record* next(record->next);
+            delete record;
+            record = next;
+        }
+    }
+
+
+    template <typename Record>
+    inline Record&
+    thread_registry<Record>::local()
+    {
+        Record* record(static_cast<Record*>(
+                    thread_registry_slots::get(m_id)));
+        return record ? *record : adopt();
+    }
+
+
+    template <typename Record>
+    Record*
+    thread_registry<Record>::first() const
+    {
+        return MPM_LOAD(&m_records, memory_order_acquire);
+    }
+
+
+    template <typename Record>
+    std::size_t
+    thread_registry<Record>::size() const
+    {
+        return MPM_LOAD(&m_count, memory_order_relaxed);
+    }
+
+
+    template <typename Record>
+    Record&
+    thread_registry<Record>::adopt()
+    {
+        // take over the record of a thread that has exited if there is one
+        Record* record(first());
+        for(; record; record = record->next)
+        {
+            bool inactive(false);
+            if(!MPM_LOAD(&record->active, memory_order_relaxed) &&
+                    MPM_COMPARE_EXCHANGE(&record->active, &inactive, true,
+                        false, memory_order_acquire))
+                break;
+        }
+
+        if(!record)
+        {
+            record = new Record;
+            record->next = MPM_LOAD(&m_records, memory_order_relaxed);
+            while(!MPM_COMPARE_EXCHANGE(&m_records, &record->next, record,
+                        true, memory_order_release))
+                ;
+            MPM_FETCH_ADD(&m_count, 1, memory_order_relaxed);
+        }
+
+        thread_registry_slots::set(m_id, record, &thread_registry::release);
+        return *record;
+    }
+
+
+    template <typename Record>
+    void
+    thread_registry<Record>::release(void* ptr)
+    {
+        Record* record(static_cast<Record*>(ptr));
+        record->on_thread_exit();
+        MPM_STORE(&record->active, false, memory_order_release);
+    }
+}
+
+}
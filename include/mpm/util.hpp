@@ -20,6 +20,75 @@ namespace mpm {
 }
 
 
+/// The destructive interference size, i.e. how far apart two objects must be
+/// for writes to one to never invalidate the cache line holding the other.
+/// Define it on the command line to override the per-architecture guess
+/// below, which is deliberately larger than the coherency line size the
+/// hardware reports where prefetchers fetch lines in pairs.
+#ifndef MPM_CACHELINE_SIZE
+    #if defined(__x86_64__) || defined(__i386__)
+        // the adjacent line prefetcher pulls in lines in 128 byte pairs
+        #define MPM_CACHELINE_SIZE 128
+    #elif defined(__powerpc64__) || defined(__aarch64__)
+        #define MPM_CACHELINE_SIZE 128
+    #elif defined(__s390x__)
+        #define MPM_CACHELINE_SIZE 256
+    #else
+        #define MPM_CACHELINE_SIZE 64
+    #endif
+#endif
+
+
+#if defined(__GNUC__)
+    #define MPM_ALIGNED(bytes) __attribute__((aligned(bytes)))
+#else
+    #define MPM_ALIGNED(bytes)
+#endif
+
+
+// Hints that the cache line holding addr is about to be read
+#if defined(__GNUC__)
+    #define MPM_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+    #define MPM_PREFETCH(addr) ((void)(addr))
+#endif
+
+
+namespace mpm {
+
+    /// \brief Holds a T on a cache line (or lines) of its own
+    ///
+    /// Both the alignment and the size of a cache_padded<T> are a multiple of
+    /// MPM_CACHELINE_SIZE so neither neighbouring cache_padded values nor
+    /// any other members of an enclosing object can share a line with the T.
+    /// Note that operator new ignores over-alignment before C++17; the
+    /// padding still keeps heap allocated neighbours apart.
+    template <typename T>
+    class MPM_ALIGNED(MPM_CACHELINE_SIZE) cache_padded
+    {
+    public:
+        typedef T value_type;
+
+        cache_padded() : m_value() {}
+
+        template <typename Arg>
+        explicit cache_padded(const Arg& arg) : m_value(arg) {}
+
+        T& get() { return m_value; }
+        const T& get() const { return m_value; }
+
+        T& operator*() { return m_value; }
+        const T& operator*() const { return m_value; }
+
+        T* operator->() { return &m_value; }
+        const T* operator->() const { return &m_value; }
+
+    private:
+        T m_value;
+    };
+}
+
+
 #define MPM_JOIN(X, Y) __MPM_DO_JOIN(X, Y)
 #define __MPM_DO_JOIN(X, Y) X##Y
 
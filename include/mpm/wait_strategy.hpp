@@ -0,0 +1,101 @@
+#pragma once
+
+#include "mpm/atomic.hpp"
+#include "mpm/backoff.hpp"
+#include "mpm/eventcount.hpp"
+#include "mpm/util.hpp"
+
+namespace mpm {
+
+/// \file
+/// Strategies for a consumer waiting on an empty queue.
+///
+/// A wait strategy is a member of its queue. The queue's pop_wait() hands
+/// the queue to the strategy's pop_wait(queue), which retries queue.pop()
+/// until it returns a value, and every push calls the strategy's notify()
+/// once the pushed value is visible to the consumer.
+
+
+/// \brief Retries pop() with Backoff between attempts and never sleeps
+///
+/// Wakes up the quickest but keeps a core busy for as long as the consumer
+/// waits. notify() does nothing, so producers pay nothing.
+template <typename Backoff>
+struct spin_wait
+{
+    void notify() {}
+
+    template <typename Queue>
+    typename Queue::pointer pop_wait(Queue& queue)
+    {
+        Backoff backoff;
+        typename Queue::pointer value;
+        while(!(value = queue.pop()))
+            backoff();
+        return value;
+    }
+};
+
+
+/// Retries pop() back to back
+typedef spin_wait<no_backoff> busy_spin_wait;
+
+/// Executes a cpu relax between attempts, leaving more of the core to an
+/// SMT sibling
+typedef spin_wait<pause_backoff> pause_wait;
+
+/// Spins for a while and then yields the processor between attempts; see
+/// spin_then_yield_backoff
+typedef spin_wait<spin_then_yield_backoff<> > yield_wait;
+
+
+/// \brief Spins for up to Spins attempts and then sleeps on a futex until a
+/// producer wakes it
+///
+/// Suits queues that are idle most of the time. The consumer announces
+/// that it is about to sleep through an eventcount, so a push only makes a
+/// system call while the consumer is asleep or about to be; otherwise it
+/// costs a fence and a load.
+template <unsigned int Spins=128>
+class park_wait
+{
+public:
+    park_wait() {}
+
+    void notify() { m_events.notify_one(); }
+
+    template <typename Queue>
+    typename Queue::pointer pop_wait(Queue& queue);
+
+private:
+    MPM_DISALLOW_COPY_AND_ASSIGN(park_wait);
+
+    eventcount m_events;
+};
+
+
+template <unsigned int Spins>
+template <typename Queue>
+typename Queue::pointer
+park_wait<Spins>::pop_wait(Queue& queue)
+{
+    typename Queue::pointer value;
+    for(unsigned int i = 0; i < Spins; i++)
+    {
+        if((value = queue.pop()))
+            return value;
+        MPM_CPU_RELAX();
+    }
+    while(true)
+    {
+        eventcount::key_type key(m_events.prepare_wait());
+        if((value = queue.pop()))
+        {
+            m_events.cancel_wait();
+            return value;
+        }
+        m_events.commit_wait(key);
+    }
+}
+
+}
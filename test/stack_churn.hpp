@@ -0,0 +1,134 @@
+#pragma once
+
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+#include <vector>
+
+/// \file
+/// Entries and multi-threaded churn drivers shared by the stack test suites.
+
+namespace mpm_test {
+
+    /// \brief A stack entry that counts how many times one was destroyed
+    struct counted : mpm::intrusive_lockfree_stack_entry<counted>
+    {
+        ~counted()
+        {
+            MPM_FETCH_ADD(&destroyed(), 1, mpm::memory_order_relaxed);
+        }
+
+        static int& destroyed()
+        {
+            static int count(0);
+            return count;
+        }
+    };
+
+
+    template <typename Stack>
+    struct churn_data
+    {
+        pthread_barrier_t* barrier;
+        Stack* stack;
+        unsigned int iterations;
+        void (*step)(Stack&);
+    };
+
+
+    template <typename Stack>
+    void* churn_thread(void* in)
+    {
+        churn_data<Stack>* data(static_cast<churn_data<Stack>*>(in));
+        pthread_barrier_wait(data->barrier);
+        for(unsigned int i = 0; i < data->iterations; i++)
+            data->step(*data->stack);
+        return NULL;
+    }
+
+
+    /// pops an entry and pushes it straight back
+    template <typename Stack>
+    void recycle(Stack& stack)
+    {
+        typename Stack::pointer popped(stack.pop());
+        if(popped)
+            stack.push(*popped);
+    }
+
+
+    /// pops an entry, retires it to Domain's global domain and pushes a
+    /// fresh one in its place
+    template <typename Stack, typename Domain>
+    void replace(Stack& stack)
+    {
+        typename Stack::pointer popped(stack.pop());
+        if(popped)
+            Domain::global().retire(popped);
+        stack.push(*new typename Stack::value_type);
+    }
+
+
+    /// \brief Runs nthreads threads that each call step(stack) iterations
+    /// times, calling during(stack) on this thread once they have started
+    template <typename Stack, typename During>
+    void churn(Stack& stack, int nthreads, unsigned int iterations,
+            void (*step)(Stack&), During during)
+    {
+        pthread_barrier_t barrier;
+        std::vector<pthread_t> threads(nthreads);
+        std::vector<churn_data<Stack> > data(nthreads);
+        REQUIRE(0 == pthread_barrier_init(&barrier, NULL, nthreads + 1));
+        for(int i = 0; i < nthreads; i++)
+        {
+            churn_data<Stack> d = { &barrier, &stack, iterations, step };
+            data[i] = d;
+            REQUIRE(0 == pthread_create(
+                        &threads[i], NULL, &churn_thread<Stack>, &data[i]));
+        }
+        pthread_barrier_wait(&barrier);
+        during(stack);
+        for(int i = 0; i < nthreads; i++)
+            pthread_join(threads[i], NULL);
+        pthread_barrier_destroy(&barrier);
+    }
+
+
+    template <typename Stack>
+    void nothing(Stack&)
+    {
+    }
+
+
+    template <typename Stack>
+    void churn(Stack& stack, int nthreads, unsigned int iterations,
+            void (*step)(Stack&))
+    {
+        churn(stack, nthreads, iterations, step, &nothing<Stack>);
+    }
+
+
+    /// \brief Concurrently pops, retires and replaces the entries of a
+    /// Stack of counted that reclaims through Domain, then checks that
+    /// the stack still holds as many entries as it started with
+    template <typename Stack, typename Domain>
+    void replace_churn()
+    {
+        static const int nthreads = 4;
+        static const unsigned int nentries = 16;
+
+        Stack stack;
+        for(unsigned int i = 0; i < nentries; i++)
+            stack.push(*new counted);
+
+        churn(stack, nthreads, 100000, &replace<Stack, Domain>);
+
+        unsigned int remaining(0);
+        while(counted* popped = stack.pop())
+        {
+            delete popped;
+            remaining++;
+        }
+        CHECK(nentries == remaining);
+    }
+}
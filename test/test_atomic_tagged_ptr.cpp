@@ -72,3 +72,75 @@ TEST_CASE("mpm/atomic_tagged_ptr/cas_success",
     CHECK(tag == y);
 
 }
+
+
+TEST_CASE("mpm/atomic_tagged_ptr/explicit_ordering",
+          "Operations accept an explicit memory ordering")
+{
+    mpm::atomic_tagged_ptr<int> ptr;
+    ptr.set(&x, x, mpm::memory_order_release);
+    CHECK_FALSE(ptr.compare_and_swap(&y, &y, x, y, mpm::memory_order_acq_rel));
+    REQUIRE(ptr.compare_and_swap(&x, &y, x, y, mpm::memory_order_release));
+    uint16_t tag = -1;
+    int* ptrval(ptr.get(tag, mpm::memory_order_acquire));
+    CHECK(ptrval == &y);
+    CHECK(tag == y);
+}
+
+
+TEST_CASE("mpm/atomic_tagged_ptr/wide_tag",
+          "A 64 bit tag is stored in full alongside the pointer")
+{
+    const uint64_t big_tag = 0x123456789abcdefull;
+    mpm::atomic_tagged_ptr<int, uint64_t> ptr(&x, big_tag);
+    uint64_t tag = 0;
+    CHECK(ptr.get(tag) == &x);
+    CHECK(tag == big_tag);
+
+    CHECK_FALSE(ptr.compare_and_swap(&x, &y, big_tag + 1, 0));
+    REQUIRE(ptr.compare_and_swap(&x, &y, big_tag, big_tag + 1));
+    CHECK(ptr.get(tag) == &y);
+    CHECK(tag == big_tag + 1);
+
+    ptr.set(&x, 0);
+    CHECK(ptr.get(tag) == &x);
+    CHECK(tag == 0);
+}
+
+
+TEST_CASE("mpm/atomic_tagged_ptr/compare_exchange",
+          "A failed compare_exchange writes back the observed value")
+{
+    mpm::atomic_tagged_ptr<int> ptr(&x, x);
+    int* expected_ptr(&y);
+    uint16_t expected_tag(y);
+    CHECK_FALSE(ptr.compare_exchange_strong(
+                expected_ptr, &y, expected_tag, y));
+    CHECK(expected_ptr == &x);
+    CHECK(expected_tag == x);
+
+    while(!ptr.compare_exchange_weak(expected_ptr, &y, expected_tag, y))
+        ;
+    uint16_t tag = -1;
+    CHECK(ptr.get(tag) == &y);
+    CHECK(tag == y);
+}
+
+
+TEST_CASE("mpm/atomic_tagged_ptr/wide_compare_exchange",
+          "A failed double-width compare_exchange writes back the observed value")
+{
+    const uint64_t big_tag = 0x123456789abcdefull;
+    mpm::atomic_tagged_ptr<int, uint64_t> ptr(&x, big_tag);
+    int* expected_ptr(&y);
+    uint64_t expected_tag(0);
+    CHECK_FALSE(ptr.compare_exchange_strong(
+                expected_ptr, &y, expected_tag, 1));
+    CHECK(expected_ptr == &x);
+    CHECK(expected_tag == big_tag);
+
+    REQUIRE(ptr.compare_exchange_weak(expected_ptr, &y, expected_tag, 1));
+    uint64_t tag = 0;
+    CHECK(ptr.get(tag) == &y);
+    CHECK(tag == 1);
+}
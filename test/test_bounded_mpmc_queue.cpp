@@ -0,0 +1,146 @@
+#include "mpm/bounded_mpmc_queue.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+namespace {
+
+    typedef mpm::bounded_mpmc_queue<unsigned int, 64> queue_type;
+
+
+    struct producer_data
+    {
+        queue_type* queue;
+        unsigned int start;
+        unsigned int producers;
+        unsigned int count;
+    };
+
+
+    void* producer(void* in)
+    {
+        producer_data* data(static_cast<producer_data*>(in));
+        for(unsigned int i = data->start; i < data->count; i += data->producers)
+        {
+            // yield so that a full queue does not keep the consumers off
+            // the cpu
+            while(!data->queue->try_push(i))
+                sched_yield();
+        }
+        return 0;
+    }
+
+
+    struct consumer_data
+    {
+        queue_type* queue;
+        unsigned int* remaining;
+        std::vector<unsigned int>* seen;
+    };
+
+
+    void* consumer(void* in)
+    {
+        consumer_data* data(static_cast<consumer_data*>(in));
+        unsigned int value;
+        while(MPM_LOAD(data->remaining, mpm::memory_order_relaxed) > 0)
+        {
+            if(!data->queue->try_pop(value))
+            {
+                sched_yield();
+                continue;
+            }
+            // each value is popped by exactly one consumer
+            (*data->seen)[value]++;
+            MPM_FETCH_ADD(data->remaining, unsigned(-1),
+                    mpm::memory_order_relaxed);
+        }
+        return 0;
+    }
+}
+
+
+TEST_CASE("mpm/bounded_mpmc_queue/push_pop",
+          "Values come out in order and the queue reports full and empty")
+{
+    mpm::bounded_mpmc_queue<int, 4> queue;
+    int out(-1);
+    CHECK(4 == queue.capacity);
+    CHECK_FALSE(queue.try_pop(out));
+
+    for(int round = 0; round < 3; round++)
+    {
+        for(int i = 0; i < 4; i++)
+            CHECK(queue.try_push(round * 10 + i));
+        CHECK_FALSE(queue.try_push(99));
+
+        for(int i = 0; i < 4; i++)
+        {
+            int expected(round * 10 + i);
+            REQUIRE(queue.try_pop(out));
+            CHECK(expected == out);
+        }
+        CHECK_FALSE(queue.try_pop(out));
+    }
+}
+
+
+TEST_CASE("mpm/bounded_mpmc_queue/interleaved",
+          "Pushes and pops interleave across the wrap")
+{
+    mpm::bounded_mpmc_queue<int, 2> queue;
+    int out(-1);
+    for(int i = 0; i < 10; i++)
+    {
+        CHECK(queue.try_push(i));
+        REQUIRE(queue.try_pop(out));
+        CHECK(i == out);
+    }
+    CHECK_FALSE(queue.try_pop(out));
+}
+
+
+TEST_CASE("mpm/bounded_mpmc_queue/go_like_hell",
+          "Concurrent producers and consumers pop every value exactly once")
+{
+    static const unsigned int nproducers = 4;
+    static const unsigned int nconsumers = 4;
+    static const unsigned int count = 200000;
+
+    queue_type queue;
+    unsigned int remaining(count);
+    std::vector<std::vector<unsigned int> > seen(
+            nconsumers, std::vector<unsigned int>(count, 0));
+
+    pthread_t threads[nproducers + nconsumers];
+    producer_data pdata[nproducers];
+    consumer_data cdata[nconsumers];
+    for(unsigned int i = 0; i < nconsumers; i++)
+    {
+        consumer_data d = { &queue, &remaining, &seen[i] };
+        cdata[i] = d;
+        REQUIRE(0 == pthread_create(&threads[i], NULL, &consumer, &cdata[i]));
+    }
+    for(unsigned int i = 0; i < nproducers; i++)
+    {
+        producer_data d = { &queue, i, nproducers, count };
+        pdata[i] = d;
+        REQUIRE(0 == pthread_create(
+                    &threads[nconsumers + i], NULL, &producer, &pdata[i]));
+    }
+    for(unsigned int i = 0; i < nproducers + nconsumers; i++)
+        pthread_join(threads[i], NULL);
+
+    unsigned int once(0);
+    for(unsigned int v = 0; v < count; v++)
+    {
+        unsigned int times(0);
+        for(unsigned int i = 0; i < nconsumers; i++)
+            times += seen[i][v];
+        once += 1 == times;
+    }
+    CHECK(count == once);
+    unsigned int out;
+    CHECK_FALSE(queue.try_pop(out));
+}
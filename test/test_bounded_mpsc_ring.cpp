@@ -0,0 +1,131 @@
+#include "mpm/bounded_mpsc_ring.hpp"
+#include "catch.hpp"
+#include <iterator>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+namespace {
+
+    typedef mpm::bounded_mpsc_ring<unsigned int, 64> ring_type;
+
+
+    struct producer_data
+    {
+        ring_type* ring;
+        unsigned int start;
+        unsigned int producers;
+        unsigned int count;
+        bool blocking;
+    };
+
+
+    void* producer(void* in)
+    {
+        producer_data* data(static_cast<producer_data*>(in));
+        for(unsigned int i = data->start; i < data->count; i += data->producers)
+        {
+            if(data->blocking)
+                data->ring->push(i);
+            else
+            {
+                // yield so that a full ring does not keep the consumer off
+                // the cpu
+                while(!data->ring->try_push(i))
+                    sched_yield();
+            }
+        }
+        return 0;
+    }
+}
+
+
+TEST_CASE("mpm/bounded_mpsc_ring/push_pop",
+          "Values come out in order and try_push fails once the ring is full")
+{
+    mpm::bounded_mpsc_ring<int, 4> ring;
+    int out(-1);
+    CHECK_FALSE(ring.pop(out));
+
+    for(int round = 0; round < 3; round++)
+    {
+        for(int i = 0; i < 4; i++)
+            CHECK(ring.try_push(round * 10 + i));
+        CHECK_FALSE(ring.try_push(99));
+
+        for(int i = 0; i < 4; i++)
+        {
+            int expected(round * 10 + i);
+            REQUIRE(ring.pop(out));
+            CHECK(expected == out);
+        }
+        CHECK_FALSE(ring.pop(out));
+    }
+}
+
+
+TEST_CASE("mpm/bounded_mpsc_ring/pop_bulk",
+          "pop_bulk pops up to max values in order across the wrap")
+{
+    mpm::bounded_mpsc_ring<int, 8> ring;
+    std::vector<int> out;
+
+    for(int i = 0; i < 6; i++)
+        ring.push(i);
+    CHECK(6 == ring.pop_bulk(std::back_inserter(out), 100));
+    for(int i = 6; i < 14; i++)
+        ring.push(i);
+    CHECK_FALSE(ring.try_push(14));
+
+    CHECK(3 == ring.pop_bulk(std::back_inserter(out), 3));
+    CHECK(5 == ring.pop_bulk(std::back_inserter(out), 100));
+    CHECK(0 == ring.pop_bulk(std::back_inserter(out), 100));
+    REQUIRE(14 == out.size());
+    for(int i = 0; i < 14; i++)
+        CHECK(i == out[i]);
+}
+
+
+TEST_CASE("mpm/bounded_mpsc_ring/go_like_hell",
+          "Concurrent producers lose nothing and keep their own order")
+{
+    static const unsigned int nproducers = 8;
+    static const unsigned int count = 200000;
+
+    ring_type ring;
+    pthread_t threads[nproducers];
+    producer_data data[nproducers];
+    for(unsigned int i = 0; i < nproducers; i++)
+    {
+        // half the producers block on a full ring, half retry try_push
+        producer_data d = { &ring, i, nproducers, count, 0 == i % 2 };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(&threads[i], NULL, &producer, &data[i]));
+    }
+
+    std::vector<unsigned int> next(nproducers);
+    for(unsigned int i = 0; i < nproducers; i++)
+        next[i] = i;
+    unsigned int popped(0), in_order(0);
+    unsigned int batch[16];
+    while(popped < count)
+    {
+        std::size_t n(ring.pop_bulk(batch, 16));
+        if(0 == n)
+            sched_yield();
+        for(std::size_t i = 0; i < n; i++)
+        {
+            unsigned int p(batch[i] % nproducers);
+            in_order += next[p] == batch[i];
+            next[p] = batch[i] + nproducers;
+        }
+        popped += n;
+    }
+    for(unsigned int i = 0; i < nproducers; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(count == popped);
+    CHECK(count == in_order);
+    unsigned int out;
+    CHECK_FALSE(ring.pop(out));
+}
@@ -0,0 +1,44 @@
+#include "mpm/deadline.hpp"
+#include "catch.hpp"
+
+
+TEST_CASE("mpm/deadline/spin_deadline",
+          "A spin deadline expires after the given number of spins")
+{
+    mpm::spin_deadline none(0);
+    CHECK(none.expired());
+
+    mpm::spin_deadline three(3);
+    CHECK_FALSE(three.expired());
+    CHECK_FALSE(three.expired());
+    CHECK_FALSE(three.expired());
+    CHECK(three.expired());
+    CHECK(three.expired());
+}
+
+
+TEST_CASE("mpm/deadline/tsc_calibration",
+          "The calibrated tsc rate is positive and stable")
+{
+    double cycles_per_ns(mpm::tsc_cycles_per_ns());
+    CHECK(cycles_per_ns > 0);
+    CHECK(cycles_per_ns == mpm::tsc_cycles_per_ns());
+    CHECK(cycles_per_ns == mpm::calibrate_tsc());
+}
+
+
+TEST_CASE("mpm/deadline/tsc_deadline",
+          "A tsc deadline expires once its timeout has passed")
+{
+    static const unsigned int timeout_ns = 2000000;
+
+    uint64_t start(mpm::detail::monotonic_ns());
+    mpm::tsc_deadline deadline(timeout_ns);
+    while(!deadline.expired())
+        ;
+    uint64_t elapsed(mpm::detail::monotonic_ns() - start);
+
+    // generous bounds; the calibration only needs to be roughly right
+    CHECK(elapsed >= timeout_ns * 9 / 10);
+    CHECK(elapsed < timeout_ns * 100);
+}
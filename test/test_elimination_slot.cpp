@@ -0,0 +1,106 @@
+#include "mpm/elimination_slot.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+
+namespace {
+
+    typedef mpm::elimination_slot<int> int_slot;
+
+
+    struct waiter_data
+    {
+        int_slot* slot;
+        int* in;
+        int* out;
+        mpm::exchange_result result;
+    };
+
+
+    // the waiters retry when they bounce off the main thread's probe
+    void* waiting_push(void* in)
+    {
+        waiter_data* data(static_cast<waiter_data*>(in));
+        do
+        {
+            data->result = data->slot->push(data->in, 1000000000);
+        } while(mpm::exchange_contended == data->result);
+        return NULL;
+    }
+
+
+    void* waiting_pop(void* in)
+    {
+        waiter_data* data(static_cast<waiter_data*>(in));
+        do
+        {
+            data->result = data->slot->pop(data->out, 1000000000);
+        } while(mpm::exchange_contended == data->result);
+        return NULL;
+    }
+}
+
+
+TEST_CASE("mpm/elimination_slot/timeout",
+          "A lone push or pop times out")
+{
+    int seven(7);
+    int* out(0);
+    int_slot slot;
+    CHECK(mpm::exchange_timeout == slot.push(&seven, 10));
+    CHECK(mpm::exchange_timeout == slot.pop(out, 10));
+    CHECK(0 == out);
+}
+
+
+TEST_CASE("mpm/elimination_slot/deadline",
+          "A lone push with a deadline times out")
+{
+    int seven(7);
+    int_slot slot;
+    CHECK(mpm::exchange_timeout ==
+            slot.push_until(&seven, mpm::tsc_deadline(10000)));
+}
+
+
+TEST_CASE("mpm/elimination_slot/push_meets_pop",
+          "A waiting push hands its pointer to a pop and bounces other pushes")
+{
+    int seven(7), eight(8);
+    int_slot slot;
+    waiter_data data = { &slot, &seven, 0, mpm::exchange_timeout };
+    pthread_t thread;
+    REQUIRE(0 == pthread_create(&thread, NULL, &waiting_push, &data));
+
+    // once the waiting push is visible a second push bounces straight off
+    while(mpm::exchange_contended != slot.push(&eight, 1))
+        ;
+
+    int* out(0);
+    while(mpm::exchange_success != slot.pop(out, 1000))
+        ;
+    REQUIRE(0 == pthread_join(thread, NULL));
+    CHECK(&seven == out);
+    CHECK(mpm::exchange_success == data.result);
+}
+
+
+TEST_CASE("mpm/elimination_slot/pop_meets_push",
+          "A waiting pop takes the pointer of a push and bounces other pops")
+{
+    int seven(7);
+    int_slot slot;
+    waiter_data data = { &slot, 0, 0, mpm::exchange_timeout };
+    pthread_t thread;
+    REQUIRE(0 == pthread_create(&thread, NULL, &waiting_pop, &data));
+
+    int* out(0);
+    while(mpm::exchange_contended != slot.pop(out, 1))
+        ;
+    CHECK(0 == out);
+
+    while(mpm::exchange_success != slot.push(&seven, 1000))
+        ;
+    REQUIRE(0 == pthread_join(thread, NULL));
+    CHECK(&seven == data.out);
+    CHECK(mpm::exchange_success == data.result);
+}
@@ -0,0 +1,100 @@
+#include "mpm/elimination_tuning.hpp"
+#include "catch.hpp"
+#include "stack_churn.hpp"
+
+namespace {
+
+    using mpm_test::counted;
+
+
+    // runs 8 threads popping and pushing back 32 entries, calling retune
+    // on the main thread while they do
+    template <typename Stack, typename Retune>
+    void churn_stack(Stack& stack, Retune retune)
+    {
+        static const int nthreads = 8;
+
+        std::vector<counted> entries(nthreads * 4);
+        for(std::size_t i = 0; i < entries.size(); i++)
+            stack.push(entries[i]);
+
+        mpm_test::churn(stack, nthreads, 200000,
+                &mpm_test::recycle<Stack>, retune);
+
+        std::size_t remaining(0);
+        while(stack.pop())
+            remaining++;
+        CHECK(entries.size() == remaining);
+    }
+
+
+    template <typename Stack>
+    void cycle_parameters(Stack& stack)
+    {
+        typename Stack::elimination_params& params(
+                stack.elimination_parameters());
+        for(unsigned int i = 0; i < 10000; i++)
+        {
+            params.set_slots(std::size_t(1) << (i % 5));
+            params.set_timeout(100 + i % 1000);
+            params.set_attempts(i % 4);
+        }
+    }
+}
+
+
+TEST_CASE("mpm/elimination_tuning/runtime_params",
+          "Runtime elimination parameters start from defaults and can be set")
+{
+    typedef mpm::intrusive_lockfree_stack<
+        counted, mpm::runtime_elimination_opts<16> > stack;
+    stack lfs;
+    stack::elimination_params& params(lfs.elimination_parameters());
+    CHECK(16 == params.slots());
+    CHECK(500 == params.timeout());
+    CHECK(2 == params.attempts());
+
+    params.set_slots(4);
+    params.set_timeout(50);
+    params.set_attempts(0);
+    CHECK(4 == params.slots());
+    CHECK(50 == params.timeout());
+    CHECK(0 == params.attempts());
+
+    counted n;
+    lfs.push(n);
+    CHECK(&n == lfs.pop());
+    CHECK_FALSE(lfs.pop());
+}
+
+
+TEST_CASE("mpm/elimination_tuning/retune_live",
+          "Elimination parameters change while threads use the stack")
+{
+    typedef mpm::intrusive_lockfree_stack<
+        counted, mpm::runtime_elimination_opts<16> > stack;
+    stack lfs;
+    churn_stack(lfs, &cycle_parameters<stack>);
+}
+
+
+TEST_CASE("mpm/elimination_tuning/autotuner",
+          "The autotuner completes windows and keeps parameters in bounds")
+{
+    typedef mpm::elimination_autotuner<2, 64> tuner;
+    typedef mpm::intrusive_lockfree_stack<
+        counted, mpm::runtime_elimination_opts<16, tuner> > stack;
+    stack lfs;
+    churn_stack(lfs, &mpm_test::nothing<stack>);
+
+    stack::elimination_params& params(lfs.elimination_parameters());
+    CHECK(0 < params.tuner().windows());
+    CHECK(0 < params.slots());
+    CHECK(16 >= params.slots());
+    CHECK(0 == (params.slots() & (params.slots() - 1)));
+    CHECK(0 < params.attempts());
+    CHECK(0.0 <= params.tuner().hit_rate());
+    CHECK(1.0 >= params.tuner().hit_rate());
+    CHECK(0.0 <= params.tuner().cas_failure_rate());
+    CHECK(1.0 >= params.tuner().cas_failure_rate());
+}
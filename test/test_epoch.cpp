@@ -0,0 +1,99 @@
+#include "mpm/epoch.hpp"
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "catch.hpp"
+#include "stack_churn.hpp"
+
+namespace {
+
+    using mpm_test::counted;
+
+
+    typedef mpm::intrusive_lockfree_stack<counted, mpm::disable_elimination,
+            uint16_t, mpm::no_backoff, mpm::epoch_reclamation>
+        reclaiming_stack;
+
+
+    // with the default elimination_opts
+    typedef mpm::intrusive_lockfree_stack<counted,
+            mpm::elimination_opts<16, 500, 2>, uint16_t, mpm::no_backoff,
+            mpm::epoch_reclamation>
+        eliminating_stack;
+}
+
+
+TEST_CASE("mpm/epoch/guarded_not_reclaimed",
+          "A retired object is not freed while a critical section is open")
+{
+    counted::destroyed() = 0;
+    mpm::epoch_domain domain;
+    {
+        mpm::epoch_guard guard(domain);
+        domain.retire(new counted);
+        for(int i = 0; i < 4; i++)
+            domain.reclaim();
+        CHECK(0 == counted::destroyed());
+    }
+    domain.reclaim();
+    domain.reclaim();
+    CHECK(1 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/epoch/nested_guards",
+          "A critical section lasts until the outermost guard exits")
+{
+    counted::destroyed() = 0;
+    mpm::epoch_domain domain;
+    {
+        mpm::epoch_guard outer(domain);
+        {
+            mpm::epoch_guard inner(domain);
+            domain.retire(new counted);
+        }
+        domain.reclaim();
+        domain.reclaim();
+        CHECK(0 == counted::destroyed());
+    }
+    domain.reclaim();
+    domain.reclaim();
+    CHECK(1 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/epoch/advance_threshold",
+          "Retiring past the threshold advances the epoch without reclaim()")
+{
+    counted::destroyed() = 0;
+    mpm::epoch_domain domain(4);
+    for(int i = 0; i < 12; i++)
+        domain.retire(new counted);
+    CHECK(0 < counted::destroyed());
+}
+
+
+TEST_CASE("mpm/epoch/domain_destruction",
+          "Destroying a domain frees everything it still holds")
+{
+    counted::destroyed() = 0;
+    {
+        mpm::epoch_domain domain;
+        domain.retire(new counted);
+        domain.retire(new counted);
+    }
+    CHECK(2 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/epoch/stack_churn",
+          "Concurrently pop, free and replace the entries of a stack")
+{
+    mpm_test::replace_churn<reclaiming_stack, mpm::epoch_domain>();
+}
+
+
+TEST_CASE("mpm/epoch/eliminating_stack_churn",
+          "Concurrently pop, free and replace the entries of a stack that "
+          "hands entries over through its elimination array")
+{
+    mpm_test::replace_churn<eliminating_stack, mpm::epoch_domain>();
+}
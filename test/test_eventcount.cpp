@@ -0,0 +1,223 @@
+#include "mpm/eventcount.hpp"
+#include "mpm/intrusive_lockfree_mpsc_queue.hpp"
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+    struct entry :
+        mpm::intrusive_lockfree_stack_entry<entry>,
+        mpm::intrusive_lockfree_mpsc_queue_entry<entry>
+    {
+        entry() : value(0) {}
+        unsigned int value;
+    };
+
+
+    struct flag_data
+    {
+        mpm::eventcount* events;
+        int flag;
+        int woken;
+    };
+
+
+    // waits for flag to be set with the prepare/recheck/commit protocol
+    void* flag_waiter(void* in)
+    {
+        flag_data* data(static_cast<flag_data*>(in));
+        while(true)
+        {
+            mpm::eventcount::key_type key(data->events->prepare_wait());
+            if(MPM_LOAD(&data->flag, mpm::memory_order_acquire))
+            {
+                data->events->cancel_wait();
+                break;
+            }
+            data->events->commit_wait(key);
+        }
+        data->woken = 1;
+        return NULL;
+    }
+
+
+    template <typename Adapter>
+    struct adapter_data
+    {
+        Adapter* adapter;
+        std::vector<entry>* entries;
+        unsigned int start;
+        unsigned int step;
+        unsigned int popped;
+    };
+
+
+    template <typename Adapter>
+    void* producer(void* in)
+    {
+        adapter_data<Adapter>* data(static_cast<adapter_data<Adapter>*>(in));
+        std::vector<entry>& entries(*data->entries);
+        for(unsigned int i = data->start; i < entries.size(); i += data->step)
+        {
+            // pause now and then so that the consumers fall asleep
+            if(0 == i % 512)
+                usleep(500);
+            data->adapter->push(entries[i]);
+        }
+        return NULL;
+    }
+
+
+    template <typename Adapter>
+    void* consumer(void* in)
+    {
+        adapter_data<Adapter>* data(static_cast<adapter_data<Adapter>*>(in));
+        for(; data->popped < data->entries->size() / data->step;
+                data->popped++)
+            data->adapter->pop_wait()->value++;
+        return NULL;
+    }
+}
+
+
+TEST_CASE("mpm/eventcount/stale_key",
+          "commit_wait returns at once if notified after prepare_wait")
+{
+    mpm::eventcount events;
+    events.notify_all();
+
+    mpm::eventcount::key_type key(events.prepare_wait());
+    events.notify_one();
+    events.commit_wait(key);
+
+    key = events.prepare_wait();
+    events.cancel_wait();
+    events.notify_one();
+    // nobody was waiting, so the key is still current and the wait times out
+    key = events.prepare_wait();
+    events.commit_wait(key, 1000000);
+}
+
+
+TEST_CASE("mpm/eventcount/notify_all",
+          "notify_all wakes every thread waiting for a condition")
+{
+    static const int nthreads = 4;
+
+    mpm::eventcount events;
+    pthread_t threads[nthreads];
+    flag_data data = { &events, 0, 0 };
+    flag_data per_thread[nthreads];
+    for(int i = 0; i < nthreads; i++)
+    {
+        per_thread[i] = data;
+        REQUIRE(0 == pthread_create(
+                    &threads[i], NULL, &flag_waiter, &per_thread[i]));
+    }
+
+    usleep(10000);
+    for(int i = 0; i < nthreads; i++)
+        MPM_STORE(&per_thread[i].flag, 1, mpm::memory_order_release);
+    events.notify_all();
+
+    for(int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        CHECK(1 == per_thread[i].woken);
+    }
+}
+
+
+TEST_CASE("mpm/eventcount/pop_wait_for",
+          "A blocking pop gives up on an empty container after its timeout")
+{
+    mpm::blocking_adapter<mpm::intrusive_lockfree_mpsc_queue<entry> > queue;
+    entry e;
+    queue.push(e);
+    CHECK(&e == queue.pop_wait_for(1000000));
+
+    static const uint64_t timeout_ns = 20000000;
+    uint64_t start(mpm::detail::monotonic_ns());
+    CHECK_FALSE(queue.pop_wait_for(timeout_ns));
+    uint64_t elapsed(mpm::detail::monotonic_ns() - start);
+    CHECK(elapsed >= timeout_ns);
+}
+
+
+TEST_CASE("mpm/eventcount/mpsc_queue",
+          "Producers wake a consumer sleeping on an empty MPSC queue")
+{
+    typedef mpm::blocking_adapter<mpm::intrusive_lockfree_mpsc_queue<entry> >
+        adapter;
+    static const unsigned int nproducers = 4;
+
+    adapter queue;
+    std::vector<entry> entries(nproducers * 5000);
+
+    pthread_t threads[nproducers + 1];
+    adapter_data<adapter> data[nproducers + 1];
+    for(unsigned int i = 0; i < nproducers; i++)
+    {
+        adapter_data<adapter> d = { &queue, &entries, i, nproducers, 0 };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(
+                    &threads[i], NULL, &producer<adapter>, &data[i]));
+    }
+    adapter_data<adapter> d = { &queue, &entries, 0, 1, 0 };
+    data[nproducers] = d;
+    REQUIRE(0 == pthread_create(&threads[nproducers], NULL,
+                &consumer<adapter>, &data[nproducers]));
+
+    for(unsigned int i = 0; i <= nproducers; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(entries.size() == data[nproducers].popped);
+    unsigned int once(0);
+    for(std::size_t i = 0; i < entries.size(); i++)
+        once += 1 == entries[i].value;
+    CHECK(entries.size() == once);
+    CHECK_FALSE(queue.pop());
+}
+
+
+TEST_CASE("mpm/eventcount/stack",
+          "A producer wakes consumers sleeping on an empty stack")
+{
+    typedef mpm::blocking_adapter<mpm::intrusive_lockfree_stack<entry> >
+        adapter;
+    static const unsigned int nconsumers = 4;
+
+    adapter stack;
+    std::vector<entry> entries(nconsumers * 5000);
+
+    pthread_t threads[nconsumers + 1];
+    adapter_data<adapter> data[nconsumers + 1];
+    for(unsigned int i = 0; i < nconsumers; i++)
+    {
+        adapter_data<adapter> d = { &stack, &entries, 0, nconsumers, 0 };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(
+                    &threads[i], NULL, &consumer<adapter>, &data[i]));
+    }
+    adapter_data<adapter> d = { &stack, &entries, 0, 1, 0 };
+    data[nconsumers] = d;
+    REQUIRE(0 == pthread_create(&threads[nconsumers], NULL,
+                &producer<adapter>, &data[nconsumers]));
+
+    unsigned int popped(0);
+    for(unsigned int i = 0; i <= nconsumers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        popped += data[i].popped;
+    }
+
+    CHECK(entries.size() == popped);
+    unsigned int once(0);
+    for(std::size_t i = 0; i < entries.size(); i++)
+        once += 1 == entries[i].value;
+    CHECK(entries.size() == once);
+    CHECK(stack.container().empty());
+}
@@ -0,0 +1,96 @@
+#include "mpm/hazard_pointer.hpp"
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "catch.hpp"
+#include "stack_churn.hpp"
+
+namespace {
+
+    using mpm_test::counted;
+
+
+    typedef mpm::intrusive_lockfree_stack<counted, mpm::disable_elimination,
+            uint16_t, mpm::no_backoff, mpm::hazard_pointer_reclamation>
+        reclaiming_stack;
+
+
+    // with the default elimination_opts
+    typedef mpm::intrusive_lockfree_stack<counted,
+            mpm::elimination_opts<16, 500, 2>, uint16_t, mpm::no_backoff,
+            mpm::hazard_pointer_reclamation>
+        eliminating_stack;
+}
+
+
+TEST_CASE("mpm/hazard_pointer/protected_not_reclaimed",
+          "A retired object is not freed while a hazard pointer protects it")
+{
+    counted::destroyed() = 0;
+    mpm::hazard_pointer_domain domain;
+    counted* obj(new counted);
+    mpm::atomic_tagged_ptr<counted> src(obj, 0);
+    {
+        mpm::hazard_pointer hp(domain);
+        uint16_t tag(0);
+        REQUIRE(obj == hp.protect(obj, tag, src));
+
+        src.set(NULL, 1);
+        domain.retire(obj);
+        domain.reclaim();
+        CHECK(0 == counted::destroyed());
+    }
+    domain.reclaim();
+    CHECK(1 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/hazard_pointer/protect_follows_source",
+          "protect() returns the current value of the source")
+{
+    counted a, b;
+    mpm::atomic_tagged_ptr<counted> src(&b, 7);
+    mpm::hazard_pointer hp;
+    uint16_t tag(0);
+    CHECK(&b == hp.protect(&a, tag, src));
+    CHECK(7 == tag);
+}
+
+
+TEST_CASE("mpm/hazard_pointer/scan_threshold",
+          "Retired objects are freed once the scan threshold is reached")
+{
+    counted::destroyed() = 0;
+    mpm::hazard_pointer_domain domain(8);
+    for(int i = 0; i < 7; i++)
+        domain.retire(new counted);
+    CHECK(0 == counted::destroyed());
+    domain.retire(new counted);
+    CHECK(8 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/hazard_pointer/domain_destruction",
+          "Destroying a domain frees everything it still holds")
+{
+    counted::destroyed() = 0;
+    {
+        mpm::hazard_pointer_domain domain;
+        domain.retire(new counted);
+        domain.retire(new counted);
+    }
+    CHECK(2 == counted::destroyed());
+}
+
+
+TEST_CASE("mpm/hazard_pointer/stack_churn",
+          "Concurrently pop, free and replace the entries of a stack")
+{
+    mpm_test::replace_churn<reclaiming_stack, mpm::hazard_pointer_domain>();
+}
+
+
+TEST_CASE("mpm/hazard_pointer/eliminating_stack_churn",
+          "Concurrently pop, free and replace the entries of a stack that "
+          "hands entries over through its elimination array")
+{
+    mpm_test::replace_churn<eliminating_stack, mpm::hazard_pointer_domain>();
+}
@@ -1,6 +1,7 @@
 #include "mpm/intrusive_lockfree_mpsc_queue.hpp"
 #include "catch.hpp"
 #include <pthread.h>
+#include <unistd.h>
 #include <vector>
 
 namespace {
@@ -18,9 +19,13 @@ namespace {
         return lhs->value < rhs->value;
     }
 
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry> queue_type;
+
+
+    template <typename Queue>
     struct producer_data
     {
-        mpm::intrusive_lockfree_mpsc_queue<entry>* queue;
+        Queue* queue;
         pthread_barrier_t* start_barrier;
         pthread_barrier_t* producers_done_barrier;
         std::vector<entry>* entries;
@@ -29,9 +34,10 @@ namespace {
     };
 
 
+    template <typename Queue>
     void* producer(void* in)
     {
-        producer_data* data(static_cast<producer_data*>(in));
+        producer_data<Queue>* data(static_cast<producer_data<Queue>*>(in));
         pthread_barrier_wait(data->start_barrier);
         for(unsigned int i = data->start; i < data->entries->size(); i += data->producers)
             data->queue->push(data->entries->at(i));
@@ -40,18 +46,48 @@ namespace {
     }
 
 
+    // pushes this producer's share of the entries as chains of up to
+    // batch entries
+    template <typename Queue>
+    void* chain_producer(void* in)
+    {
+        static const unsigned int batch = 32;
+        producer_data<Queue>* data(static_cast<producer_data<Queue>*>(in));
+        std::vector<entry>& entries(*data->entries);
+        pthread_barrier_wait(data->start_barrier);
+        unsigned int i = data->start;
+        while(i < entries.size())
+        {
+            entry* first(&entries[i]);
+            entry* last(first);
+            i += data->producers;
+            for(unsigned int n = 1; n < batch && i < entries.size(); n++)
+            {
+                mpm_intrusive_lockfree_mpsc_queue_set_next(*last, &entries[i]);
+                last = &entries[i];
+                i += data->producers;
+            }
+            data->queue->push_chain(*first, *last);
+        }
+        pthread_barrier_wait(data->producers_done_barrier);
+        return 0;
+    }
+
+
+    template <typename Queue>
     struct consumer_data
     {
-        mpm::intrusive_lockfree_mpsc_queue<entry>* queue;
+        Queue* queue;
         entry* poison;
         std::vector<entry*>* consumed;
         pthread_barrier_t* start_barrier;
     };
 
 
+    template <typename Queue>
     void* consumer(void* in)
     {
-        consumer_data* data(static_cast<consumer_data*>(in));
+        consumer_data<Queue>* data(static_cast<consumer_data<Queue>*>(in));
         pthread_barrier_wait(data->start_barrier);
         entry* popped(NULL);
         while(true)
@@ -64,33 +100,80 @@ namespace {
         }
         return 0;
     }
-}
 
-TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/push_pop",
-          "Simple push and pop")
-{
-    entry e0(0), e1(1), e2(2);
-    mpm::intrusive_lockfree_mpsc_queue<entry> queue;
 
-    queue.push(e0);
-    queue.push(e1);
-    queue.push(e2);
+    template <typename Queue>
+    void* retrying_consumer(void* in)
+    {
+        consumer_data<Queue>* data(static_cast<consumer_data<Queue>*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        entry* popped(NULL);
+        while(true)
+        {
+            popped = data->queue->pop(mpm::pause_backoff());
+            if(popped == data->poison)
+                return 0;
+            if(popped)
+               data->consumed->push_back(popped);
+        }
+        return 0;
+    }
 
-    CHECK(0 == queue.pop()->value);
-    CHECK(1 == queue.pop()->value);
-    CHECK(2 == queue.pop()->value);
 
-    CHECK(0 == queue.pop());
-}
+    template <typename Queue>
+    void* bulk_consumer(void* in)
+    {
+        static const std::size_t batch = 32;
+        consumer_data<Queue>* data(static_cast<consumer_data<Queue>*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        entry* popped[batch];
+        while(true)
+        {
+            std::size_t count(data->queue->pop_bulk(popped, batch));
+            for(std::size_t i = 0; i < count; i++)
+            {
+                // poison is the last entry pushed
+                if(popped[i] == data->poison)
+                    return 0;
+                data->consumed->push_back(popped[i]);
+            }
+        }
+        return 0;
+    }
 
 
-TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell",
-          "Concurrent pushing and popping")
+    struct collector
+    {
+        explicit collector(std::vector<entry*>& _out) : out(&_out) {}
+        void operator()(entry* e) { out->push_back(e); }
+        std::vector<entry*>* out;
+    };
+
+
+    template <typename Queue>
+    void* waiting_consumer(void* in)
+    {
+        consumer_data<Queue>* data(static_cast<consumer_data<Queue>*>(in));
+        pthread_barrier_wait(data->start_barrier);
+        while(true)
+        {
+            entry* popped(data->queue->pop_wait());
+            if(popped == data->poison)
+                return 0;
+            data->consumed->push_back(popped);
+        }
+        return 0;
+    }
+}
+
+template <typename Queue>
+void go_like_hell(void* (*consume)(void*),
+        void* (*produce)(void*) = &producer<Queue>)
 {
     static int nthreads = 8;
     static int nentries = 100000;
 
-    mpm::intrusive_lockfree_mpsc_queue<entry> queue;
+    Queue queue;
     std::vector<entry> entries(nentries);
     for(int i = 0; i < nentries; i++)
         entries[i].value = i;
@@ -103,7 +186,7 @@ TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell",
     consumed.reserve(entries.size());
 
     pthread_t producer_threads[nthreads];
-    producer_data producer_data_arr[nthreads];
+    producer_data<Queue> producer_data_arr[nthreads];
     for(int i = 0; i < nthreads; i++)
     {
         producer_data_arr[i].queue = &queue;
@@ -113,12 +196,12 @@ TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell",
         producer_data_arr[i].start = i;
         producer_data_arr[i].producers = nthreads;
         REQUIRE(0 == pthread_create(
-            &producer_threads[i], NULL, &producer, &producer_data_arr[i]));
+            &producer_threads[i], NULL, produce, &producer_data_arr[i]));
     }
 
     pthread_t consumer_thread;
-    consumer_data consumer_d = { &queue, &consumer_poison, &consumed, &start_barrier };
-    REQUIRE(0 == pthread_create(&consumer_thread, NULL, &consumer, &consumer_d));
+    consumer_data<Queue> consumer_d = { &queue, &consumer_poison, &consumed, &start_barrier };
+    REQUIRE(0 == pthread_create(&consumer_thread, NULL, consume, &consumer_d));
 
     //block until producers finish
     pthread_barrier_wait(&producers_done_barrier);
@@ -142,3 +225,231 @@ TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell",
         CHECK(i == consumed[i]->value);
 }
 
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/push_pop",
+          "Simple push and pop")
+{
+    entry e0(0), e1(1), e2(2);
+    mpm::intrusive_lockfree_mpsc_queue<entry> queue;
+
+    queue.push(e0);
+    queue.push(e1);
+    queue.push(e2);
+
+    CHECK(0 == queue.pop()->value);
+    CHECK(1 == queue.pop()->value);
+    CHECK(2 == queue.pop()->value);
+
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/push_chain",
+          "A pushed chain is popped in chain order after earlier values")
+{
+    entry e0(0), e1(1), e2(2), e3(3), e4(4);
+    queue_type queue;
+
+    queue.push(e0);
+    mpm_intrusive_lockfree_mpsc_queue_set_next(e1, &e2);
+    mpm_intrusive_lockfree_mpsc_queue_set_next(e2, &e3);
+    queue.push_chain(e1, e3);
+    queue.push_chain(e4, e4);
+
+    for(unsigned int i = 0; i < 5; i++)
+    {
+        entry* popped(queue.pop());
+        REQUIRE(popped);
+        CHECK(i == popped->value);
+    }
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/compact_layout",
+          "Simple push and pop with the compact layout")
+{
+    entry e0(0), e1(1);
+    mpm::intrusive_lockfree_mpsc_queue<entry, mpm::mpsc_compact_layout> queue;
+
+    queue.push(e0);
+    queue.push(e1);
+
+    CHECK(0 == queue.pop()->value);
+    CHECK(1 == queue.pop()->value);
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/retrying_pop",
+          "A retrying pop returns values in order and NULL when empty")
+{
+    entry e0(0), e1(1);
+    mpm::intrusive_lockfree_mpsc_queue<entry> queue;
+
+    CHECK(0 == queue.pop(mpm::pause_backoff()));
+    queue.push(e0);
+    queue.push(e1);
+
+    CHECK(0 == queue.pop(mpm::no_backoff())->value);
+    CHECK(1 == queue.pop(mpm::no_backoff())->value);
+    CHECK(0 == queue.pop(mpm::no_backoff()));
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/pop_bulk",
+          "pop_bulk pops up to max values in order")
+{
+    entry entries[5];
+    for(unsigned int i = 0; i < 5; i++)
+        entries[i].value = i;
+    queue_type queue;
+    entry* popped[5];
+
+    CHECK(0 == queue.pop_bulk(popped, 5));
+    for(unsigned int i = 0; i < 5; i++)
+        queue.push(entries[i]);
+
+    REQUIRE(2 == queue.pop_bulk(popped, 2));
+    CHECK(0 == popped[0]->value);
+    CHECK(1 == popped[1]->value);
+    REQUIRE(3 == queue.pop_bulk(popped, 5));
+    CHECK(2 == popped[0]->value);
+    CHECK(3 == popped[1]->value);
+    CHECK(4 == popped[2]->value);
+    CHECK(0 == queue.pop_bulk(popped, 5));
+
+    // the queue keeps working after it has been drained
+    queue.push(entries[0]);
+    CHECK(&entries[0] == queue.pop());
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/consume_all",
+          "consume_all passes every value to the callback in order")
+{
+    entry entries[4];
+    for(unsigned int i = 0; i < 4; i++)
+        entries[i].value = i;
+    queue_type queue;
+    std::vector<entry*> consumed;
+
+    CHECK(0 == queue.consume_all(collector(consumed)));
+    queue.push(entries[0]);
+    queue.push(entries[1]);
+    CHECK(&entries[0] == queue.pop());
+    queue.push(entries[2]);
+    queue.push(entries[3]);
+
+    REQUIRE(3 == queue.consume_all(collector(consumed)));
+    for(unsigned int i = 0; i < consumed.size(); i++)
+    {
+        unsigned int expected(i + 1);
+        CHECK(expected == consumed[i]->value);
+    }
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell",
+          "Concurrent pushing and popping")
+{
+    go_like_hell<queue_type>(&consumer<queue_type>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_retrying",
+          "Concurrent pushing and popping with a retrying consumer")
+{
+    go_like_hell<queue_type>(&retrying_consumer<queue_type>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_pop_bulk",
+          "Concurrent pushing and bulk popping")
+{
+    go_like_hell<queue_type>(&bulk_consumer<queue_type>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_push_chain",
+          "Concurrent chain pushing and popping")
+{
+    go_like_hell<queue_type>(&consumer<queue_type>, &chain_producer<queue_type>);
+    go_like_hell<queue_type>(
+            &bulk_consumer<queue_type>, &chain_producer<queue_type>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_busy_spin_wait",
+          "Concurrent pushing and popping with a busy spinning consumer")
+{
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry,
+            mpm::mpsc_padded_layout, mpm::busy_spin_wait> queue;
+    go_like_hell<queue>(&waiting_consumer<queue>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_pause_wait",
+          "Concurrent pushing and popping with a pausing consumer")
+{
+    go_like_hell<queue_type>(&waiting_consumer<queue_type>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_yield_wait",
+          "Concurrent pushing and popping with a yielding consumer")
+{
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry,
+            mpm::mpsc_padded_layout, mpm::yield_wait> queue;
+    go_like_hell<queue>(&waiting_consumer<queue>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/go_like_hell_park_wait",
+          "Concurrent pushing and popping with a parking consumer")
+{
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry,
+            mpm::mpsc_padded_layout, mpm::park_wait<> > queue;
+    go_like_hell<queue>(&waiting_consumer<queue>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_mpsc_queue/park_wait",
+          "Pushes wake a consumer parked on an empty queue")
+{
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry,
+            mpm::mpsc_compact_layout, mpm::park_wait<16> > queue_t;
+    static const int nentries = 2000;
+
+    queue_t queue;
+    std::vector<entry> entries(nentries);
+    for(int i = 0; i < nentries; i++)
+        entries[i].value = i;
+
+    pthread_barrier_t start_barrier;
+    REQUIRE(0 == pthread_barrier_init(&start_barrier, NULL, 2));
+    entry poison;
+    std::vector<entry*> consumed;
+    pthread_t consumer_thread;
+    consumer_data<queue_t> consumer_d =
+        { &queue, &poison, &consumed, &start_barrier };
+    REQUIRE(0 == pthread_create(&consumer_thread, NULL,
+                &waiting_consumer<queue_t>, &consumer_d));
+
+    // pause now and then so that the consumer parks
+    pthread_barrier_wait(&start_barrier);
+    for(int i = 0; i < nentries; i++)
+    {
+        if(0 == i % 64)
+            usleep(500);
+        queue.push(entries[i]);
+    }
+    queue.push(poison);
+    REQUIRE(0 == pthread_join(consumer_thread, NULL));
+
+    REQUIRE(entries.size() == consumed.size());
+    for(unsigned int i = 0; i < consumed.size(); i++)
+        CHECK(i == consumed[i]->value);
+}
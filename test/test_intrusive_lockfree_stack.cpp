@@ -1,6 +1,9 @@
 #include "mpm/intrusive_lockfree_stack.hpp"
+#include "mpm/stats.hpp"
 #include "catch.hpp"
+#include <algorithm>
 #include <pthread.h>
+#include <unistd.h>
 
 
 struct entry : mpm::intrusive_lockfree_stack_entry<entry>
@@ -32,11 +35,14 @@ orthogonal_entry* mpm_lfs_get_next(orthogonal_entry const& n)
 }
 
 
+//use a smaller array with more spins to make elimination more likely
+typedef mpm::elimination_opts<2, 10000, 1> pushpop_elimination;
+
+
+template <typename Stack>
 struct pushpop_data
 {
-    //use a smaller array with more spins to make elimination more likely
-    typedef mpm::intrusive_lockfree_stack<
-        entry, mpm::elimination_opts<2, 10000, 1> > stack_type;
+    typedef Stack stack_type;
 
     pthread_barrier_t* barrier;
     unsigned int iterations;
@@ -44,9 +50,10 @@ struct pushpop_data
 };
 
 
+template <typename Stack>
 void* pushpop(void* in)
 {
-    pushpop_data* data(static_cast<pushpop_data*>(in));
+    pushpop_data<Stack>* data(static_cast<pushpop_data<Stack>*>(in));
     pthread_barrier_wait(data->barrier);
 
     for(unsigned int i = 0; i < data->iterations; i++)
@@ -58,6 +65,125 @@ void* pushpop(void* in)
 }
 
 
+// pops a batch of entries one at a time and pushes them back as a chain
+template <typename Stack>
+void* chainpush(void* in)
+{
+    static const unsigned int batch = 4;
+    pushpop_data<Stack>* data(static_cast<pushpop_data<Stack>*>(in));
+    pthread_barrier_wait(data->barrier);
+
+    entry* popped[batch];
+    for(unsigned int i = 0; i < data->iterations; i++)
+    {
+        unsigned int count(0);
+        while(count < batch && (popped[count] = data->stack->pop()))
+            count++;
+        if(0 == count)
+            continue;
+        for(unsigned int j = 1; j < count; j++)
+            mpm_lfs_set_next(*popped[j - 1], popped[j]);
+        data->stack->push_chain(*popped[0], *popped[count - 1]);
+    }
+    return NULL;
+}
+
+
+struct pusher_data
+{
+    pthread_barrier_t* barrier;
+    mpm::intrusive_lockfree_stack<entry>* stack;
+    entry* entries;
+    unsigned int count;
+};
+
+
+void* pusher(void* in)
+{
+    pusher_data* data(static_cast<pusher_data*>(in));
+    pthread_barrier_wait(data->barrier);
+    for(unsigned int i = 0; i < data->count; i++)
+        data->stack->push(data->entries[i]);
+    return NULL;
+}
+
+
+// a stack whose poppers can sleep in pop_wait()
+typedef mpm::intrusive_lockfree_stack<entry, mpm::elimination_opts<16, 500, 2>,
+        uint16_t, mpm::no_backoff, mpm::no_reclamation, mpm::no_stats,
+        mpm::futex_parking<> > blocking_stack;
+
+
+struct waiter_data
+{
+    blocking_stack* stack;
+    unsigned int count;
+    unsigned int popped;
+};
+
+
+void* waiter(void* in)
+{
+    waiter_data* data(static_cast<waiter_data*>(in));
+    for(; data->popped < data->count; data->popped++)
+        data->stack->pop_wait();
+    return NULL;
+}
+
+
+// An entry whose links, when armed, push an interloper onto meddled_stack
+// from inside a push or pop so that the CAS that follows fails
+struct meddling_entry
+{
+    meddling_entry() : next(0) {}
+    meddling_entry* next;
+};
+
+
+// one slot and a long timeout so that a failed pop waits for a partner
+typedef mpm::intrusive_lockfree_stack<meddling_entry, mpm::elimination_opts<
+    1, 200000000, 1, mpm::fixed_elimination_range, mpm::random_slot_selector,
+    mpm::tsc_deadline>, uint16_t, mpm::no_backoff, mpm::no_reclamation,
+    mpm::contention_stats> meddled_stack;
+
+
+meddled_stack* meddled(NULL);
+meddling_entry* push_on_set_next(NULL);
+meddling_entry* push_on_get_next(NULL);
+
+
+void meddle(meddling_entry** interloper)
+{
+    meddling_entry* e(MPM_EXCHG_EXPLICIT(interloper,
+                static_cast<meddling_entry*>(NULL),
+                mpm::memory_order_seq_cst));
+    if(e)
+        meddled->push(*e);
+}
+
+
+void mpm_lfs_set_next(meddling_entry& n, meddling_entry* next)
+{
+    n.next = next;
+    meddle(&push_on_set_next);
+}
+
+
+meddling_entry* mpm_lfs_get_next(meddling_entry const& n)
+{
+    meddle(&push_on_get_next);
+    return n.next;
+}
+
+
+void* meddled_pop(void* in)
+{
+    meddling_entry** out(static_cast<meddling_entry**>(in));
+    *out = meddled->pop();
+    return NULL;
+}
+
+
 template <typename OutputIterator, typename Stack>
 OutputIterator drain(Stack & stack, OutputIterator out)
 {
@@ -69,6 +195,40 @@ OutputIterator drain(Stack & stack, OutputIterator out)
 
 
 
+template <typename Stack>
+void go_like_hell(void* (*worker)(void*) = &pushpop<Stack>)
+{
+    static const int nthreads = 8;
+    static const int nodes_per_thread = 5;
+
+    Stack stack;
+    unsigned int entry_count(nthreads * nodes_per_thread);
+    typename Stack::value_type entries[entry_count];
+    for(unsigned int i = 0; i < entry_count; i++)
+        stack.push(entries[i]);
+
+    pthread_barrier_t barrier;
+    pthread_t threads[nthreads];
+    pushpop_data<Stack> pushpop_data_arr[nthreads];
+    REQUIRE(0 == pthread_barrier_init(&barrier, NULL, nthreads));
+    for(int i = 0; i < nthreads; i++)
+    {
+        pushpop_data_arr[i].barrier = &barrier;
+        pushpop_data_arr[i].iterations = 1000000;
+        pushpop_data_arr[i].stack = &stack;
+        REQUIRE(0 == pthread_create(
+            &threads[i], NULL, worker, &pushpop_data_arr[i]));
+    }
+
+    for(int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    std::vector<typename Stack::pointer> popped_ptrs;
+    drain(stack, std::back_inserter(popped_ptrs));
+    CHECK(entry_count == popped_ptrs.size());
+}
+
+
 TEST_CASE("mpm/intrusive_lockfree_stack/push_pop",
           "A stack must have LIFO nature")
 {
@@ -89,6 +249,84 @@ TEST_CASE("mpm/intrusive_lockfree_stack/push_pop",
 }
 
 
+TEST_CASE("mpm/intrusive_lockfree_stack/push_chain",
+          "A pushed chain lands on the stack as a unit with first on top")
+{
+    mpm::intrusive_lockfree_stack<entry> lfs;
+    entry zero(0), one(1), two(2), three(3);
+    lfs.push(three);
+    mpm_lfs_set_next(zero, &one);
+    mpm_lfs_set_next(one, &two);
+    lfs.push_chain(zero, two);
+
+    for(int i = 0; i < 4; i++)
+    {
+        entry* popped(lfs.pop());
+        REQUIRE(popped);
+        CHECK(popped->value == i);
+    }
+    CHECK_FALSE(lfs.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/push_chain_whole",
+          "A chain whose CAS fails is not split by handing its head to a pop "
+          "waiting in the elimination array")
+{
+    meddled_stack lfs;
+    meddled = &lfs;
+    meddling_entry bottom, pop_interloper, push_interloper, chain[3];
+    lfs.push(bottom);
+
+    // the pop's CAS fails and it waits in the elimination slot
+    MPM_STORE(&push_on_get_next, &pop_interloper, mpm::memory_order_seq_cst);
+    meddling_entry* popped(NULL);
+    pthread_t popper;
+    REQUIRE(0 == pthread_create(&popper, NULL, &meddled_pop, &popped));
+    while(MPM_LOAD(&push_on_get_next, mpm::memory_order_seq_cst))
+        usleep(1000);
+    usleep(20000);
+
+    // then so does the chain's
+    mpm_lfs_set_next(chain[0], &chain[1]);
+    mpm_lfs_set_next(chain[1], &chain[2]);
+    MPM_STORE(&push_on_set_next, &push_interloper, mpm::memory_order_seq_cst);
+    lfs.push_chain(chain[0], chain[2]);
+    pthread_join(popper, NULL);
+
+    CHECK(0 == lfs.stats().elimination_hits);
+    CHECK(&chain[0] == popped);
+    meddling_entry* expected[] = {
+        &chain[1], &chain[2], &push_interloper, &pop_interloper, &bottom };
+    std::vector<meddling_entry*> rest;
+    drain(lfs, std::back_inserter(rest));
+    CHECK(std::vector<meddling_entry*>(expected, expected + 5) == rest);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/push_range",
+          "A pushed range lands on the stack in order with begin on top")
+{
+    mpm::intrusive_lockfree_stack<orthogonal_entry> lfs;
+    std::vector<orthogonal_entry> entries;
+    for(int i = 0; i < 5; i++)
+        entries.push_back(orthogonal_entry(i));
+
+    lfs.push_range(entries.begin(), entries.begin());
+    CHECK(lfs.empty());
+
+    lfs.push_range(entries.begin() + 3, entries.end());
+    lfs.push_range(entries.begin(), entries.begin() + 3);
+    for(int i = 0; i < 5; i++)
+    {
+        orthogonal_entry* popped(lfs.pop());
+        REQUIRE(popped);
+        CHECK(popped->value == i);
+    }
+    CHECK_FALSE(lfs.pop());
+}
+
+
 TEST_CASE("mpm/intrusive_lockfree_stack/pop_empty",
           "Popping an empty stack should return NULL")
 {
@@ -127,6 +365,136 @@ TEST_CASE("mpm/intrusive_lockfree_stack/clear_empty",
 }
 
 
+TEST_CASE("mpm/intrusive_lockfree_stack/pop_all",
+          "pop_all detaches the whole stack as a LIFO chain")
+{
+    typedef mpm::intrusive_lockfree_stack<entry> stack;
+    stack lfs;
+    CHECK_FALSE(lfs.pop_all());
+
+    entry zero(0), one(1), two(2);
+    lfs.push(two);
+    lfs.push(one);
+    lfs.push(zero);
+
+    entry* chain(lfs.pop_all());
+    CHECK(lfs.empty());
+
+    // move each entry to another stack while walking the chain, which
+    // relinks the entry under the iterator
+    stack other;
+    int expected(0);
+    for(stack::chain_iterator it(chain); it != stack::chain_iterator(); ++it)
+    {
+        CHECK(expected++ == it->value);
+        other.push(*it);
+    }
+    CHECK(3 == expected);
+    CHECK(&two == other.pop());
+    CHECK(&one == other.pop());
+    CHECK(&zero == other.pop());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/pop_all_concurrent",
+          "pop_all races with concurrent pushes without losing entries")
+{
+    static const int nthreads = 4;
+    static const unsigned int per_thread = 100000;
+
+    mpm::intrusive_lockfree_stack<entry> lfs;
+    std::vector<entry> entries(nthreads * per_thread);
+
+    pthread_barrier_t barrier;
+    pthread_t threads[nthreads];
+    pusher_data data[nthreads];
+    REQUIRE(0 == pthread_barrier_init(&barrier, NULL, nthreads + 1));
+    for(int i = 0; i < nthreads; i++)
+    {
+        pusher_data d = { &barrier, &lfs, &entries[i * per_thread], per_thread };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(&threads[i], NULL, &pusher, &data[i]));
+    }
+
+    pthread_barrier_wait(&barrier);
+    std::size_t detached(0);
+    while(detached < entries.size())
+    {
+        mpm::lfs_chain_iterator<entry> it(lfs.pop_all()), end;
+        detached += std::distance(it, end);
+    }
+    for(int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(entries.size() == detached);
+    CHECK(lfs.empty());
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/pop_wait_ready",
+          "pop_wait returns at once when the stack is not empty and "
+          "pop_wait_for gives up on an empty stack")
+{
+    blocking_stack lfs;
+    entry one(1), two(2);
+    lfs.push(two);
+    lfs.push(one);
+    CHECK(&one == lfs.pop_wait());
+    CHECK(&two == lfs.pop_wait_for(1000000));
+
+    static const uint64_t timeout_ns = 20000000;
+    uint64_t start(mpm::detail::monotonic_ns());
+    CHECK_FALSE(lfs.pop_wait_for(timeout_ns));
+    uint64_t elapsed(mpm::detail::monotonic_ns() - start);
+    CHECK(elapsed >= timeout_ns);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/pop_wait",
+          "Pushes wake poppers sleeping on an empty stack")
+{
+    static const int nthreads = 4;
+    static const unsigned int per_thread = 2000;
+
+    blocking_stack lfs;
+    std::vector<entry> entries(nthreads * per_thread);
+
+    pthread_t threads[nthreads];
+    waiter_data data[nthreads];
+    for(int i = 0; i < nthreads; i++)
+    {
+        waiter_data d = { &lfs, per_thread, 0 };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(&threads[i], NULL, &waiter, &data[i]));
+    }
+
+    // pause now and then so that the waiters fall asleep, and push some
+    // entries as chains to wake several at once
+    for(std::size_t i = 0; i < entries.size(); )
+    {
+        if(0 == i % 256)
+            usleep(1000);
+        if(0 == i % 3 && i + 2 < entries.size())
+        {
+            mpm_lfs_set_next(entries[i], &entries[i + 1]);
+            lfs.push_chain(entries[i], entries[i + 1]);
+            i += 2;
+        }
+        else
+            lfs.push(entries[i++]);
+    }
+
+    unsigned int popped(0);
+    for(int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        popped += data[i].popped;
+    }
+    CHECK(entries.size() == popped);
+    CHECK(lfs.empty());
+}
+
+
 TEST_CASE("mpm/intrusive_lockfree_stack/skip_elimination",
           "Run with elimination turned off")
 {
@@ -138,37 +506,126 @@ TEST_CASE("mpm/intrusive_lockfree_stack/skip_elimination",
 }
 
 
-TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell",
-          "Concurrent threads pushing & popping")
+TEST_CASE("mpm/intrusive_lockfree_stack/adaptive_range",
+          "The adaptive elimination range shrinks on timeouts and grows on "
+          "collisions")
 {
-    static const int nthreads = 8;
-    static const int nodes_per_thread = 5;
+    // a threshold no other test uses so that this thread's state is fresh
+    typedef mpm::adaptive_elimination_range<2> range;
+    CHECK(16 == range::width(16));
+
+    range::record(16, mpm::exchange_timeout);
+    range::record(16, mpm::exchange_success);
+    CHECK(16 == range::width(16));
+    range::record(16, mpm::exchange_timeout);
+    CHECK(8 == range::width(16));
+
+    for(int i = 0; i < 20; i++)
+        range::record(16, mpm::exchange_timeout);
+    CHECK(1 == range::width(16));
+
+    range::record(16, mpm::exchange_contended);
+    range::record(16, mpm::exchange_contended);
+    CHECK(2 == range::width(16));
+}
 
-    pushpop_data::stack_type stack;
-    unsigned int entry_count(nthreads * nodes_per_thread);
-    pushpop_data::stack_type::value_type entries[entry_count];
-    for(unsigned int i = 0; i < entry_count; i++)
-        stack.push(entries[i]);
 
-    pthread_barrier_t barrier;
-    pthread_t threads[nthreads];
-    pushpop_data pushpop_data_arr[nthreads];
-    REQUIRE(0 == pthread_barrier_init(&barrier, NULL, nthreads));
-    for(int i = 0; i < nthreads; i++)
+TEST_CASE("mpm/intrusive_lockfree_stack/slot_selectors",
+          "Slot selectors stay within the width they are given")
+{
+    bool hit[16] = { false };
+    for(int i = 0; i < 1000; i++)
     {
-        pushpop_data_arr[i].barrier = &barrier;
-        pushpop_data_arr[i].iterations = 1000000;
-        pushpop_data_arr[i].stack = &stack;
-        REQUIRE(0 == pthread_create(
-            &threads[i], NULL, &pushpop, &pushpop_data_arr[i]));
+        std::size_t slot(mpm::random_slot_selector::select(16));
+        REQUIRE(slot < 16);
+        hit[slot] = true;
     }
+    CHECK(std::count(hit, hit + 16, true) == 16);
 
-    for(int i = 0; i < nthreads; i++)
-        pthread_join(threads[i], NULL);
+    std::size_t sticky(mpm::sticky_slot_selector::select(16));
+    CHECK(sticky < 16);
+    CHECK(sticky == mpm::sticky_slot_selector::select(16));
+    CHECK((sticky & 3) == mpm::sticky_slot_selector::select(4));
+    CHECK(0 == mpm::sticky_slot_selector::select(1));
+}
 
-    std::vector<typename pushpop_data::stack_type::pointer> popped_ptrs;
-    drain(stack, std::back_inserter(popped_ptrs));
-    CHECK(entry_count == popped_ptrs.size());
+
+TEST_CASE("mpm/intrusive_lockfree_stack/wide_tag",
+          "Run with a double-width tag on the top of the stack")
+{
+    mpm::intrusive_lockfree_stack<
+        entry, mpm::elimination_opts<16, 500, 2>, uint64_t> lfs;
+    entry zero(0), one(1);
+    lfs.push(one);
+    lfs.push(zero);
+    CHECK(&zero == lfs.pop());
+    CHECK(&one == lfs.pop());
+    CHECK_FALSE(lfs.pop());
 }
 
 
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell",
+          "Concurrent threads pushing & popping")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, pushpop_elimination> >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_push_chain",
+          "Concurrent threads popping & pushing back chains")
+{
+    typedef mpm::intrusive_lockfree_stack<entry, pushpop_elimination> stack;
+    go_like_hell<stack>(&chainpush<stack>);
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_adaptive_range",
+          "Concurrent threads pushing & popping with an adaptive elimination "
+          "range")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, mpm::elimination_opts<
+        16, 500, 2, mpm::adaptive_elimination_range<> > > >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_sticky_slots",
+          "Concurrent threads pushing & popping with sticky elimination slots")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, mpm::elimination_opts<
+        2, 10000, 1, mpm::fixed_elimination_range,
+        mpm::sticky_slot_selector> > >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_tsc_deadline",
+          "Concurrent threads pushing & popping with elimination timeouts in "
+          "nanoseconds")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, mpm::elimination_opts<
+        2, 2000, 1, mpm::fixed_elimination_range, mpm::random_slot_selector,
+        mpm::tsc_deadline> > >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_wide_tag",
+          "Concurrent threads pushing & popping with a double-width tag")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<
+        entry, pushpop_elimination, uint64_t> >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_exponential_backoff",
+          "Concurrent threads pushing & popping with exponential backoff")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, pushpop_elimination,
+        uint16_t, mpm::exponential_backoff<> > >();
+}
+
+
+TEST_CASE("mpm/intrusive_lockfree_stack/go_like_hell_spin_then_yield",
+          "Concurrent threads pushing & popping, yielding under contention")
+{
+    go_like_hell<mpm::intrusive_lockfree_stack<entry, mpm::disable_elimination,
+        uint16_t, mpm::spin_then_yield_backoff<> > >();
+}
@@ -23,6 +23,25 @@ void* exchange(void* thread_data)
 }
 
 
+typedef mpm::lockfree_exchanger<int, mpm::pause_backoff> paused_exchanger;
+
+
+struct paused_exchange_data
+{
+    paused_exchanger& exchanger;
+    paused_exchanger::ptr_type in;
+    paused_exchanger::ref_ptr_type out;
+};
+
+
+void* paused_exchange(void* thread_data)
+{
+    paused_exchange_data* data(static_cast<paused_exchange_data*>(thread_data));
+    data->exchanger.exchange(data->in, data->out, 1000000000);
+    return NULL;
+}
+
+
 TEST_CASE("mpm/lockfree_exchanger/successful_exchange",
           "Test a successful pointer exchange")
 {
@@ -69,3 +88,37 @@ TEST_CASE("mpm/lockfree_exchanger/missed_connection",
     CHECK(7 == main_thread_in);
     CHECK(0 == main_thread_out);
 }
+
+
+TEST_CASE("mpm/lockfree_exchanger/try_exchange_timeout",
+          "A lone thread times out waiting for a partner")
+{
+    int seven = 7;
+    int* out = 0;
+
+    int_exchanger lfe;
+    CHECK(mpm::exchange_timeout == lfe.try_exchange(&seven, out, 10));
+    CHECK(0 == out);
+}
+
+
+TEST_CASE("mpm/lockfree_exchanger/pause_backoff",
+          "Exchange pointers while pausing in the spin loops")
+{
+    int seven = 7;
+    int eight = 8;
+    int * main_thread_out = 0;
+    int * bg_thread_out = 0;
+
+    paused_exchanger lfe;
+    CHECK_FALSE(lfe.exchange(&seven, main_thread_out, 1));
+
+    paused_exchange_data edata = { lfe, &eight, bg_thread_out };
+    pthread_t thread;
+    REQUIRE(0 == pthread_create(&thread, NULL, &paused_exchange, &edata));
+    REQUIRE(lfe.exchange(&seven, main_thread_out, 1000000000));
+    REQUIRE(0 == pthread_join(thread, NULL));
+
+    CHECK(&eight == main_thread_out);
+    CHECK(&seven == bg_thread_out);
+}
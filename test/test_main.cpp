@@ -1,2 +1,8 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
+#include "mpm/deadline.hpp"
+
+namespace {
+    // calibrate before any test builds a tsc_deadline
+    const double tsc_cycles_per_ns(mpm::calibrate_tsc());
+}
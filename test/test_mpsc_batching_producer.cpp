@@ -0,0 +1,180 @@
+#include "mpm/mpsc_batching_producer.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+    struct entry : mpm::intrusive_lockfree_mpsc_queue_entry<entry>
+    {
+        entry() : value(0) {}
+        unsigned int value;
+    };
+
+    typedef mpm::intrusive_lockfree_mpsc_queue<entry> queue_type;
+    typedef mpm::mpsc_batching_producer<entry> producer_type;
+
+
+    struct producer_data
+    {
+        queue_type* queue;
+        std::vector<entry>* entries;
+        unsigned int start;
+        unsigned int producers;
+        std::size_t max_batch;
+    };
+
+
+    void* producer(void* in)
+    {
+        producer_data* data(static_cast<producer_data*>(in));
+        std::vector<entry>& entries(*data->entries);
+        producer_type batcher(*data->queue, data->max_batch);
+        for(unsigned int i = data->start; i < entries.size(); i += data->producers)
+            batcher.push(entries[i]);
+        return 0;
+    }
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/max_batch",
+          "Values reach the queue in order once a batch fills up")
+{
+    queue_type queue;
+    entry entries[5];
+    for(unsigned int i = 0; i < 5; i++)
+        entries[i].value = i;
+
+    producer_type batcher(queue, 3);
+    batcher.push(entries[0]);
+    batcher.push(entries[1]);
+    CHECK(2 == batcher.pending());
+    CHECK(0 == queue.pop());
+
+    batcher.push(entries[2]);
+    CHECK(0 == batcher.pending());
+    batcher.push(entries[3]);
+    for(unsigned int i = 0; i < 3; i++)
+    {
+        entry* popped(queue.pop());
+        REQUIRE(popped);
+        CHECK(i == popped->value);
+    }
+    CHECK(0 == queue.pop());
+
+    batcher.flush();
+    CHECK(&entries[3] == queue.pop());
+    batcher.flush();
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/destructor",
+          "Destroying a producer flushes its chain")
+{
+    queue_type queue;
+    entry e0, e1;
+    {
+        producer_type batcher(queue);
+        batcher.push(e0);
+        batcher.push(e1);
+        CHECK(0 == queue.pop());
+    }
+    CHECK(&e0 == queue.pop());
+    CHECK(&e1 == queue.pop());
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/unbatched",
+          "A max_batch of one pushes every value straight through")
+{
+    queue_type queue;
+    entry e0;
+    producer_type batcher(queue, 1);
+    batcher.push(e0);
+    CHECK(0 == batcher.pending());
+    CHECK(&e0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/deadline",
+          "A chain is flushed once its oldest value has waited long enough")
+{
+    static const uint64_t max_delay_ns = 2000000;
+    queue_type queue;
+    entry e0, e1, e2;
+    producer_type batcher(queue, 1000, max_delay_ns);
+
+    batcher.push(e0);
+    CHECK_FALSE(batcher.flush_if_expired());
+    usleep(5000);
+    CHECK(batcher.flush_if_expired());
+    CHECK(&e0 == queue.pop());
+
+    // a push after the deadline flushes the chain including itself
+    batcher.push(e1);
+    usleep(5000);
+    batcher.push(e2);
+    CHECK(0 == batcher.pending());
+    CHECK(&e1 == queue.pop());
+    CHECK(&e2 == queue.pop());
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/concurrent",
+          "Batching producers lose nothing and keep each producer's order")
+{
+    static const unsigned int nproducers = 4;
+    static const unsigned int nentries = 100003;
+
+    queue_type queue;
+    std::vector<entry> entries(nentries);
+    for(unsigned int i = 0; i < nentries; i++)
+        entries[i].value = i;
+
+    pthread_t threads[nproducers];
+    producer_data data[nproducers];
+    for(unsigned int i = 0; i < nproducers; i++)
+    {
+        producer_data d = { &queue, &entries, i, nproducers, 16 + i };
+        data[i] = d;
+        REQUIRE(0 == pthread_create(&threads[i], NULL, &producer, &data[i]));
+    }
+
+    std::vector<unsigned int> next(nproducers);
+    for(unsigned int i = 0; i < nproducers; i++)
+        next[i] = i;
+    unsigned int popped(0), in_order(0);
+    while(popped < nentries)
+    {
+        entry* e(queue.pop());
+        if(!e)
+            continue;
+        unsigned int p(e->value % nproducers);
+        in_order += next[p] == e->value;
+        next[p] = e->value + nproducers;
+        popped++;
+    }
+    for(unsigned int i = 0; i < nproducers; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(nentries == in_order);
+    CHECK(0 == queue.pop());
+}
+
+
+TEST_CASE("mpm/mpsc_batching_producer/huge_deadline",
+          "A delay too long to count in ticks never expires")
+{
+    queue_type queue;
+    entry e;
+    producer_type batcher(queue, 1000, producer_type::no_deadline - 1);
+
+    batcher.push(e);
+    usleep(1000);
+    CHECK_FALSE(batcher.flush_if_expired());
+    CHECK(1 == batcher.pending());
+}
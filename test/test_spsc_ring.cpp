@@ -0,0 +1,125 @@
+#include "mpm/spsc_ring.hpp"
+#include "catch.hpp"
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+    typedef mpm::spsc_ring<unsigned int, 64> ring_type;
+
+    static const unsigned int go_like_hell_count = 1000000;
+
+
+    // fills runs of slots in place, up to 16 at a time
+    void* producer(void* in)
+    {
+        ring_type* ring(static_cast<ring_type*>(in));
+        unsigned int next(0);
+        while(next < go_like_hell_count)
+        {
+            unsigned int* slots;
+            std::size_t n(ring->reserve(slots, 16));
+            if(0 == n)
+            {
+                sched_yield();
+                continue;
+            }
+            std::size_t filled(0);
+            for(; filled < n && next < go_like_hell_count; filled++)
+                slots[filled] = next++;
+            ring->commit(filled);
+        }
+        return 0;
+    }
+}
+
+
+TEST_CASE("mpm/spsc_ring/push_pop",
+          "Values come out in order and the ring reports full and empty")
+{
+    mpm::spsc_ring<int, 4> ring;
+    int out(-1);
+    CHECK(4 == ring.capacity);
+    CHECK_FALSE(ring.try_pop(out));
+
+    for(int round = 0; round < 3; round++)
+    {
+        for(int i = 0; i < 4; i++)
+            CHECK(ring.try_push(round * 10 + i));
+        CHECK_FALSE(ring.try_push(99));
+
+        for(int i = 0; i < 4; i++)
+        {
+            int expected(round * 10 + i);
+            REQUIRE(ring.try_pop(out));
+            CHECK(expected == out);
+        }
+        CHECK_FALSE(ring.try_pop(out));
+    }
+}
+
+
+TEST_CASE("mpm/spsc_ring/reserve_commit",
+          "Batches are filled and read in place and stop at the wrap")
+{
+    mpm::spsc_ring<int, 8> ring;
+    int* slots;
+
+    REQUIRE(5 == ring.reserve(slots, 5));
+    for(int i = 0; i < 5; i++)
+        slots[i] = i;
+    // nothing is visible until it is committed
+    CHECK(0 == ring.peek(slots, 8));
+    ring.commit(5);
+
+    REQUIRE(5 == ring.peek(slots, 8));
+    CHECK(0 == slots[0]);
+    ring.consume(3);
+
+    // 6 slots are free but only 3 are contiguous before the wrap
+    REQUIRE(3 == ring.reserve(slots, 6));
+    for(int i = 0; i < 3; i++)
+        slots[i] = 5 + i;
+    ring.commit(3);
+    REQUIRE(3 == ring.reserve(slots, 6));
+    for(int i = 0; i < 3; i++)
+        slots[i] = 8 + i;
+    ring.commit(2);
+
+    int expected(3);
+    int* values;
+    std::size_t n;
+    while((n = ring.peek(values, 8)))
+    {
+        for(std::size_t i = 0; i < n; i++)
+            CHECK(expected++ == values[i]);
+        ring.consume(n);
+    }
+    CHECK(10 == expected);
+}
+
+
+TEST_CASE("mpm/spsc_ring/go_like_hell",
+          "A producer and a consumer pass every value through in order")
+{
+    ring_type ring;
+    pthread_t thread;
+    REQUIRE(0 == pthread_create(&thread, NULL, &producer, &ring));
+
+    unsigned int expected(0), in_order(0);
+    while(expected < go_like_hell_count)
+    {
+        unsigned int value;
+        if(!ring.try_pop(value))
+        {
+            sched_yield();
+            continue;
+        }
+        in_order += expected++ == value;
+    }
+    pthread_join(thread, NULL);
+
+    CHECK(go_like_hell_count == in_order);
+    unsigned int value;
+    CHECK_FALSE(ring.try_pop(value));
+}
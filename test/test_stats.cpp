@@ -0,0 +1,95 @@
+#include "mpm/intrusive_lockfree_stack.hpp"
+#include "mpm/stats.hpp"
+#include "catch.hpp"
+#include "stack_churn.hpp"
+#include <numeric>
+
+namespace {
+
+    using mpm_test::counted;
+
+
+    typedef mpm::intrusive_lockfree_stack<counted,
+            mpm::elimination_opts<2, 10000, 1>, uint16_t, mpm::no_backoff,
+            mpm::no_reclamation, mpm::contention_stats> counted_stack;
+}
+
+
+TEST_CASE("mpm/stats/no_stats",
+          "The default policy reports nothing")
+{
+    mpm::intrusive_lockfree_stack<counted> lfs;
+    counted n;
+    lfs.push(n);
+    lfs.pop();
+    mpm::stack_stats stats(lfs.stats());
+    CHECK(0 == stats.pushes);
+    CHECK(0 == stats.pops);
+    CHECK(16 == stats.slot_hits.size());
+}
+
+
+TEST_CASE("mpm/stats/single_thread",
+          "Pushes and pops are counted")
+{
+    counted_stack lfs;
+    counted a, b, c;
+    lfs.push(a);
+    lfs.push(b);
+    lfs.push(c);
+    for(int i = 0; i < 4; i++)
+        lfs.pop();
+
+    mpm::stack_stats stats(lfs.stats());
+    CHECK(3 == stats.pushes);
+    CHECK(3 == stats.pops);
+    CHECK(1 == stats.empty_pops);
+    CHECK(0 == stats.cas_failures);
+    CHECK(0 == stats.elimination_hits);
+    CHECK(2 == stats.slot_hits.size());
+}
+
+
+TEST_CASE("mpm/stats/merge",
+          "Merging snapshots adds their counts")
+{
+    mpm::stack_stats lhs(2), rhs(4);
+    lhs.pushes = 1;
+    lhs.slot_hits[1] = 2;
+    rhs.pushes = 3;
+    rhs.cas_failures = 5;
+    rhs.slot_hits[1] = 1;
+    rhs.slot_hits[3] = 7;
+
+    lhs.merge(rhs);
+    CHECK(4 == lhs.pushes);
+    CHECK(5 == lhs.cas_failures);
+    REQUIRE(4 == lhs.slot_hits.size());
+    CHECK(3 == lhs.slot_hits[1]);
+    CHECK(7 == lhs.slot_hits[3]);
+}
+
+
+TEST_CASE("mpm/stats/concurrent",
+          "Counts from every thread, including exited ones, add up")
+{
+    static const int nthreads = 8;
+    static const unsigned int iterations = 100000;
+
+    counted_stack lfs;
+    counted entries[nthreads * 2];
+    for(int i = 0; i < nthreads * 2; i++)
+        lfs.push(entries[i]);
+
+    mpm_test::churn(lfs, nthreads, iterations,
+            &mpm_test::recycle<counted_stack>);
+
+    mpm::stack_stats stats(lfs.stats());
+    uint64_t attempted_pops(uint64_t(nthreads) * iterations);
+    uint64_t total_pops(stats.pops + stats.empty_pops);
+    uint64_t total_pushes(stats.pushes - nthreads * 2);
+    CHECK(attempted_pops == total_pops);
+    CHECK(stats.pops == total_pushes);
+    CHECK(stats.elimination_hits == std::accumulate(
+                stats.slot_hits.begin(), stats.slot_hits.end(), uint64_t(0)));
+}
@@ -0,0 +1,64 @@
+#include "mpm/thread_registry.hpp"
+#include "catch.hpp"
+#include <limits.h>
+#include <pthread.h>
+#include <vector>
+
+namespace {
+
+    struct record
+    {
+        record() : active(true), next(0), value(0) {}
+        void on_thread_exit() { value = -1; }
+
+        bool active;
+        record* next;
+        int value;
+    };
+
+
+    typedef mpm::detail::thread_registry<record> registry;
+
+
+    void* set_value(void* in)
+    {
+        static_cast<registry*>(in)->local().value = 1;
+        return NULL;
+    }
+}
+
+
+TEST_CASE("mpm/thread_registry/many_registries",
+          "More registries can be alive at once than there are pthread keys")
+{
+    std::vector<registry*> registries(PTHREAD_KEYS_MAX + 16);
+    for(std::size_t i = 0; i < registries.size(); i++)
+    {
+        registries[i] = new registry;
+        registries[i]->local().value = int(i);
+    }
+
+    unsigned int kept(0);
+    for(std::size_t i = 0; i < registries.size(); i++)
+    {
+        kept += int(i) == registries[i]->local().value;
+        delete registries[i];
+    }
+    CHECK(registries.size() == kept);
+}
+
+
+TEST_CASE("mpm/thread_registry/adopt",
+          "A record released by an exiting thread is adopted by the next")
+{
+    registry r;
+    for(int i = 0; i < 2; i++)
+    {
+        pthread_t thread;
+        REQUIRE(0 == pthread_create(&thread, NULL, &set_value, &r));
+        pthread_join(thread, NULL);
+        REQUIRE(r.first());
+        CHECK(-1 == r.first()->value);
+    }
+    CHECK(1 == r.size());
+}